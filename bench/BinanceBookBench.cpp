@@ -0,0 +1,322 @@
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#include <x86intrin.h>
+#endif
+
+#include "BinanceBook.hpp"
+#include "ConsolidatedBook.hpp"
+#include "LatencyHistogram.hpp"
+
+/*
+Latency benchmark for every BinanceBook operation, at several depths and with both storage backends.
+
+Each case runs batches of `batch` calls, each on its own book so that a call never sees the state the previous one
+left behind. Every call is timed on its own with the cycle counter (fenced, so the call can't move out from between
+the two reads), less what two back-to-back reads cost, measured once at startup: the percentiles are those of single
+calls, not of averages that would hide the outliers. Books are reset outside the timed region when a case needs a
+fresh one.
+
+Results go to stdout as one JSON object per line, so runs can be diffed or gated on:
+    {"case":"update_bbo/new_top","storage":"soa","depth":20,"batches":..., "p50_ns":..., "ops_per_sec":...}
+
+Usage: BinanceBookBench [--batches N] [--filter substring]
+*/
+
+static constexpr size_t batch = 16;
+
+// Keep the optimiser from dropping a result we never look at
+template <typename T>
+static void do_not_optimize(const T& value)
+{
+    asm volatile("" : : "r,m"(value) : "memory");
+}
+
+// The cycle counter, with nothing before it still running and nothing after it started early
+static uint64_t fenced_cycles()
+{
+#if defined(__x86_64__) || defined(_M_X64)
+    _mm_lfence();
+    const uint64_t cycles = __rdtsc();
+    _mm_lfence();
+    return cycles;
+#else
+    std::atomic_signal_fence(std::memory_order_seq_cst);
+    const uint64_t cycles = read_cycle_counter();
+    std::atomic_signal_fence(std::memory_order_seq_cst);
+    return cycles;
+#endif
+}
+
+// What the cycle counter is worth, measured once
+struct CallClock
+{
+    double ps_per_cycle = 1000.0;
+    uint64_t overhead_cycles = 0; // Of an empty timed region, taken off every call
+};
+
+static CallClock calibrate_clock()
+{
+    CallClock clock;
+
+    // Rate against the steady clock, over long enough for the steady clock's resolution not to matter
+    const int64_t start_ns = steady_now_ns();
+    const uint64_t start_cycles = fenced_cycles();
+    while (steady_now_ns() - start_ns < 20'000'000) {
+    }
+    const double elapsed_ps = static_cast<double>(steady_now_ns() - start_ns) * 1000.0;
+    const uint64_t elapsed_cycles = fenced_cycles() - start_cycles;
+    if (elapsed_cycles > 0)
+        clock.ps_per_cycle = elapsed_ps / static_cast<double>(elapsed_cycles);
+
+    // Median of many empty regions, so an interrupt in one of them doesn't count
+    std::array<uint64_t, 10001> empty{};
+    for (uint64_t& cycles : empty) {
+        const uint64_t start = fenced_cycles();
+        cycles = fenced_cycles() - start;
+    }
+    std::nth_element(empty.begin(), empty.begin() + empty.size() / 2, empty.end());
+    clock.overhead_cycles = empty[empty.size() / 2];
+    return clock;
+}
+
+static const CallClock call_clock = calibrate_clock();
+
+struct Options
+{
+    size_t batches = 5000;
+    std::string_view filter;
+};
+
+struct Snapshot
+{
+    std::vector<PriceQuantity> bids, asks;
+};
+
+// n levels a side, one cent apart, around 1000.00/1000.01
+static Snapshot make_snapshot(size_t n, double quantity)
+{
+    Snapshot snapshot;
+    for (size_t l = 0; l < n; ++l) {
+        snapshot.bids.push_back({ static_cast<double>(100000 - static_cast<int>(l)) / 100.0, quantity });
+        snapshot.asks.push_back({ static_cast<double>(100001 + static_cast<int>(l)) / 100.0, quantity });
+    }
+    return snapshot;
+}
+
+template <typename Book, typename Setup, typename Op>
+static void run_case(const Options& options, std::string_view name, std::string_view storage, Setup&& setup, Op&& op)
+{
+    if (name.find(options.filter) == std::string_view::npos)
+        return;
+
+    auto books = std::make_unique<Book[]>(batch);
+    LatencyHistogram histogram; // Picoseconds per call
+    uint64_t total_ps = 0;
+
+    for (size_t b = 0; b < options.batches; ++b) {
+        for (size_t i = 0; i < batch; ++i)
+            setup(books[i]);
+
+        for (size_t i = 0; i < batch; ++i) {
+            const uint64_t start = fenced_cycles();
+            op(books[i], b);
+            const uint64_t cycles = fenced_cycles() - start;
+
+            const uint64_t net = cycles > call_clock.overhead_cycles ? cycles - call_clock.overhead_cycles : 0;
+            const auto ps = static_cast<uint64_t>(static_cast<double>(net) * call_clock.ps_per_cycle);
+            total_ps += ps;
+            histogram.record(ps);
+        }
+    }
+
+    const auto ns = [](uint64_t ps) { return static_cast<double>(ps) / 1000.0; };
+    const double ops = static_cast<double>(options.batches * batch);
+    std::printf("{\"case\":\"%.*s\",\"storage\":\"%.*s\",\"depth\":%zu,\"batches\":%zu,\"batch\":%zu,"
+                "\"mean_ns\":%.2f,\"p50_ns\":%.2f,\"p99_ns\":%.2f,\"p999_ns\":%.2f,\"max_ns\":%.2f,\"ops_per_sec\":%.0f}\n",
+                static_cast<int>(name.size()), name.data(), static_cast<int>(storage.size()), storage.data(), Book::max_depth,
+                options.batches, batch, histogram.mean() / 1000.0, ns(histogram.percentile(0.5)),
+                ns(histogram.percentile(0.99)), ns(histogram.percentile(0.999)), ns(histogram.max()),
+                total_ps > 0 ? ops * 1e12 / static_cast<double>(total_ps) : 0.0);
+    std::fflush(stdout);
+}
+
+template <size_t n, template <typename, size_t> class Storage>
+static void run_depth(const Options& options, std::string_view storage)
+{
+    using Book = BinanceBook<n, Storage>;
+
+    const Snapshot full = make_snapshot(n, 1.0);
+    const Snapshot other = make_snapshot(n, 2.0);
+    const PriceQuantity best_bid = full.bids.front(), best_ask = full.asks.front();
+    const double tick = 0.01;
+
+    const auto fill = [&](Book& book) { book.replace(full.bids, full.asks); };
+    const auto keep = [](Book&) {};
+
+    run_case<Book>(options, "replace", storage, keep, [&](Book& book, size_t b) {
+        const Snapshot& snapshot = b % 2 ? full : other;
+        book.replace(snapshot.bids, snapshot.asks);
+    });
+
+    // Same prices and quantities as the top: nothing moves
+    run_case<Book>(options, "update_bbo/no_change", storage, fill, [&](Book& book, size_t) {
+        book.update_bbo(best_bid, best_ask);
+    });
+
+    // Same prices, new quantities: only the front quantities are rewritten
+    run_case<Book>(options, "update_bbo/quantity", storage, fill, [&](Book& book, size_t b) {
+        const double quantity = static_cast<double>(b % 7 + 2);
+        book.update_bbo({ best_bid.price, quantity }, { best_ask.price, quantity });
+    });
+
+    // A new level ahead of each side, pushing the worst one out
+    run_case<Book>(options, "update_bbo/new_top", storage, fill, [&](Book& book, size_t) {
+        book.update_bbo({ best_bid.price + tick / 2, 1.0 }, { best_ask.price - tick / 2, 1.0 });
+    });
+
+    // A bid through every ask: the whole ask side is uncrossed
+    run_case<Book>(options, "update_bbo/deep_uncross", storage, fill, [&](Book& book, size_t) {
+        const double through = full.asks.back().price + tick;
+        book.update_bbo({ through, 1.0 }, { through + tick, 1.0 });
+    });
+
+    run_case<Book>(options, "extract", storage, fill, [](Book& book, size_t) { do_not_optimize(book.extract()); });
+
+    run_case<Book>(options, "is_empty", storage, fill, [](Book& book, size_t) { do_not_optimize(book.is_empty()); });
+
+    run_case<Book>(options, "to_string", storage, fill, [](Book& book, size_t) { do_not_optimize(book.to_string()); });
+
+    // Sums are maintained by the analytic storage, walked by the others
+    run_case<Book>(options, "analytics/depth", storage, fill, [](Book& book, size_t) { do_not_optimize(book.bid_depth(n)); });
+    run_case<Book>(options, "analytics/cost_to_buy", storage, fill, [](Book& book, size_t) {
+        do_not_optimize(book.cost_to_buy(static_cast<double>(n) / 2));
+    });
+}
+
+template <template <typename, size_t> class Storage>
+static void run_storage(const Options& options, std::string_view storage)
+{
+    run_depth<5, Storage>(options, storage);
+    run_depth<10, Storage>(options, storage);
+    run_depth<20, Storage>(options, storage);
+    run_depth<100, Storage>(options, storage);
+}
+
+// Deep fixed-point books from a diff stream: a level changing mid-book, packed storage against the tick ladder
+template <template <typename, size_t> class Storage>
+static void run_deep(const Options& options, std::string_view storage)
+{
+    constexpr size_t n = 5000;
+    using Book = BinanceBook<n, Storage, FixedPointPricing>;
+    using Tick = FixedPointPricing::Level;
+
+    std::vector<Tick> bids, asks;
+    for (int64_t l = 0; l < static_cast<int64_t>(n); ++l) {
+        bids.push_back({ 1'000'000 - 1 - 2 * l, 100 });
+        asks.push_back({ 1'000'000 + 1 + 2 * l, 100 });
+    }
+    const auto fill = [&](Book& book) { book.replace(bids, asks); };
+
+    // A new price a quarter of the way down, then gone again: an insert and an erase
+    run_case<Book>(options, "deep/delta_insert_erase", storage, fill, [](Book& book, size_t) {
+        const Tick level{ 1'000'000 - static_cast<int64_t>(n) / 2, 50 };
+        book.apply_delta(std::span(&level, 1), std::span<const Tick>());
+        const Tick gone{ level.price, 0 };
+        book.apply_delta(std::span(&gone, 1), std::span<const Tick>());
+    });
+
+    run_case<Book>(options, "deep/delta_quantity", storage, fill, [](Book& book, size_t b) {
+        const Tick level{ 1'000'000 - 1 - static_cast<int64_t>(n), static_cast<int64_t>(b % 7 + 1) };
+        book.apply_delta(std::span(&level, 1), std::span<const Tick>());
+    });
+
+    // Unsequenced, like the deltas above: fill's replace() doesn't set an update id for a ticker to follow
+    run_case<Book>(options, "deep/update_bbo_new_top", storage, fill, [](Book& book, size_t) {
+        book.update_bbo(Tick{ 1'000'000, 1 }, Tick{ 1'000'000 + 1, 1 });
+    });
+}
+
+// Four venues' books of 20 levels merged into one: kept up to date incrementally from the books' listeners, against
+// merging the extracts with a sort on every update
+struct Venues
+{
+    static constexpr size_t count = 4;
+    static constexpr size_t max_depth = 20;
+    using Merged = ConsolidatedBook<count, max_depth>;
+    using Book = BinanceBook<max_depth, RingSide, FloatingPointPricing, Merged::Feed<>>;
+    std::array<Book, count> books;
+    Merged merged;
+};
+
+static void run_consolidated(const Options& options)
+{
+    const Snapshot snapshot = make_snapshot(Venues::max_depth, 1.0);
+    const auto fill = [&](Venues& venues) {
+        for (size_t v = 0; v < Venues::count; ++v) {
+            venues.books[v].replace(snapshot.bids, snapshot.asks);
+            venues.merged.attach(v, venues.books[v]);
+        }
+    };
+
+    // One venue's top quantity changes, the usual tick: the update reaches the merged book through the listener
+    run_case<Venues>(options, "consolidated/update", "ring", fill, [](Venues& venues, size_t b) {
+        const size_t v = b % Venues::count;
+        venues.books[v].update_bbo({ 1000.00, 1.0 + static_cast<double>(b % 5) }, { 1000.01, 1 });
+        do_not_optimize(venues.merged.best_bid()->quantity);
+    });
+
+    run_case<Venues>(options, "consolidated/full_sort", "ring", fill, [](Venues& venues, size_t b) {
+        const size_t v = b % Venues::count;
+        venues.books[v].update_bbo({ 1000.00, 1.0 + static_cast<double>(b % 5) }, { 1000.01, 1 });
+        std::vector<PriceQuantity> bids, asks;
+        for (const auto& book : venues.books) {
+            const auto [venue_bids, venue_asks] = book.extract();
+            bids.insert(bids.end(), venue_bids.begin(), venue_bids.end());
+            asks.insert(asks.end(), venue_asks.begin(), venue_asks.end());
+        }
+        std::sort(bids.begin(), bids.end(), [](const PriceQuantity& a, const PriceQuantity& b) { return a.price > b.price; });
+        std::sort(asks.begin(), asks.end(), [](const PriceQuantity& a, const PriceQuantity& b) { return a.price < b.price; });
+        do_not_optimize(bids.front().quantity);
+    });
+}
+
+int main(int argc, char** argv)
+{
+    Options options;
+    for (int i = 1; i < argc; i += 2) {
+        if (i + 1 == argc) {
+            std::fprintf(stderr, "Usage: %s [--batches N] [--filter substring]\n", argv[0]);
+            return 1;
+        }
+        if (std::strcmp(argv[i], "--batches") == 0) {
+            options.batches = std::strtoull(argv[i + 1], nullptr, 10);
+        }
+        else if (std::strcmp(argv[i], "--filter") == 0) {
+            options.filter = argv[i + 1];
+        }
+        else {
+            std::fprintf(stderr, "Usage: %s [--batches N] [--filter substring]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (options.batches == 0)
+        options.batches = 1;
+
+    run_storage<RingSide>(options, "ring");
+    run_storage<SoaSide>(options, "soa");
+    run_storage<AnalyticRingSide>(options, "ring_analytic");
+    run_deep<RingSide>(options, "ring");
+    run_deep<LadderSide>(options, "ladder");
+    run_consolidated(options);
+}
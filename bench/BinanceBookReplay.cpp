@@ -0,0 +1,83 @@
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "BinanceBook.hpp"
+#include "CaptureReplay.hpp"
+
+/*
+Replays a capture file into a registry of BinanceBook<20>, one book per symbol found in the capture, and prints the
+result as one JSON line:
+    {"symbols":...,"events":...,"applied":...,"elapsed_ns":...,"events_per_sec":...,"mean_ns":...,"p50_ns":...,
+     "p99_ns":...,"p999_ns":...,"max_ns":...,"max_lag_ns":...}
+
+Usage: BinanceBookReplay capture.bin [--recorded-timing] [--speed X] [--huge-pages]
+
+With --huge-pages the books are placed in a prefaulted BookArena backed by huge pages (see BookArena.hpp).
+*/
+
+int main(int argc, char** argv)
+{
+    if (argc < 2) {
+        std::fprintf(stderr, "Usage: %s capture.bin [--recorded-timing] [--speed X] [--huge-pages]\n", argv[0]);
+        return 1;
+    }
+
+    ReplayOptions options;
+    bool huge_pages = false;
+    for (int i = 2; i < argc; ++i) {
+        if (std::strcmp(argv[i], "--recorded-timing") == 0) {
+            options.recorded_timing = true;
+        }
+        else if (std::strcmp(argv[i], "--speed") == 0 && i + 1 < argc) {
+            options.speed = std::strtod(argv[++i], nullptr);
+        }
+        else if (std::strcmp(argv[i], "--huge-pages") == 0) {
+            huge_pages = true;
+        }
+        else {
+            std::fprintf(stderr, "Unknown option %s\n", argv[i]);
+            return 1;
+        }
+    }
+    if (!(options.speed > 0))
+        options.speed = 1.0;
+
+    CaptureReader reader(argv[1]);
+    if (!reader.ok()) {
+        std::fprintf(stderr, "%s is not a readable capture\n", argv[1]);
+        return 1;
+    }
+
+    // First pass just to find out which books are needed
+    std::vector<std::string> symbols;
+    CaptureEvent event;
+    while (reader.next(event)) {
+        if (std::find(symbols.begin(), symbols.end(), event.symbol) == symbols.end())
+            symbols.emplace_back(event.symbol);
+    }
+    reader.rewind();
+
+    using Book = BinanceBook<20>;
+    std::unique_ptr<BookArena> arena;
+    if (huge_pages)
+        arena = std::make_unique<BookArena>(symbols.size() * (sizeof(Book) + 64), ArenaOptions{ true, true });
+    auto registry = arena ? std::make_unique<BookRegistry<Book>>(symbols.size(), *arena) : std::make_unique<BookRegistry<Book>>(symbols.size());
+    BookRegistry<Book>& books = *registry;
+    for (const std::string& symbol : symbols)
+        books.add(symbol);
+
+    const ReplayStats stats = replay(reader, books, options);
+    std::printf("{\"symbols\":%zu,\"events\":%llu,\"applied\":%llu,\"elapsed_ns\":%lld,\"events_per_sec\":%.0f,"
+                "\"mean_ns\":%.1f,\"p50_ns\":%llu,\"p99_ns\":%llu,\"p999_ns\":%llu,\"max_ns\":%llu,\"max_lag_ns\":%lld}\n",
+                symbols.size(), static_cast<unsigned long long>(stats.events), static_cast<unsigned long long>(stats.applied),
+                static_cast<long long>(stats.elapsed_ns), stats.events_per_sec(), stats.latency.mean(),
+                static_cast<unsigned long long>(stats.latency.percentile(0.5)),
+                static_cast<unsigned long long>(stats.latency.percentile(0.99)),
+                static_cast<unsigned long long>(stats.latency.percentile(0.999)),
+                static_cast<unsigned long long>(stats.latency.max()), static_cast<long long>(stats.max_lag_ns));
+}
@@ -97,8 +97,28 @@ also. Comment your code appropriately, and explain any non-trivial logic, partic
 
 #pragma once
 
+#include <algorithm>
+#include <array>
+#include <charconv>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <initializer_list>
+#include <iterator>
+#include <optional>
+#include <ranges>
+#include <span>
+#include <string>
+#include <tuple>
+#include <type_traits>
 #include <vector>
 
+#include "BookCounters.hpp"
+#include "BookListener.hpp"
+#include "BookTraits.hpp"
+#include "DepthAnalytics.hpp"
+#include "LadderSide.hpp"
+#include "SideStorage.hpp"
 #include "util.hpp"
 
 using Price = double;
@@ -113,38 +133,360 @@ struct PriceQuantity
     auto operator==(const PriceQuantity& pq) const { return essentiallyEqual(price, pq.price) && essentiallyEqual(quantity, pq.quantity); };
 };
 
-template <size_t n>
-class BinanceBook final
+// A decimal number as it appears on the wire, value = digits / 10^decimals. "20078.54000000" is { 2007854000000, 8 }.
+struct Decimal
+{
+    uint64_t digits{};
+    int decimals{};
+};
+
+/*
+Price/quantity representation policies.
+The book stores Pricing::Level and only converts from/to decimal PriceQuantity at the edges (replace, update_bbo,
+extract, to_string), so the hot path only ever compares Level prices.
+Parsers can skip the PriceQuantity step entirely and hand over the wire Decimals (see BinanceParser.hpp).
+*/
+
+// Doubles compared with essentiallyEqual, what the book has always done
+struct FloatingPointPricing
+{
+    using Level = PriceQuantity;
+
+    Level to_level(const PriceQuantity& pq) const { return pq; }
+    Level to_level(const Decimal& price, const Decimal& quantity) const { return { to_double(price), to_double(quantity) }; }
+    PriceQuantity to_decimal(const Level& level) const { return level; }
+    static bool same_price(Price a, Price b) { return essentiallyEqual(a, b); }
+
+    // Units per 1.0, as in FixedPointPricing. Levels are already decimal here.
+    static constexpr double price_scale = 1.0;
+    static constexpr double quantity_scale = 1.0;
+
+    // Both operands are exact doubles when digits < 2^53 and decimals <= 22, so the single division is correctly
+    // rounded, ie exactly what strtod returns for the string (this is the "Clinger fast path"). That covers every
+    // string of up to 15 significant digits, which is all Binance sends below 10^7 at 8 places. The parser keeps up
+    // to 17 digits though, and above 2^53 digits is rounded once on its way to a double before the division, so the
+    // result can be an ulp away from strtod's. Prices are compared with essentiallyEqual here, so that is the same
+    // level; FixedPointPricing stays in integers whatever the digit count.
+    static double to_double(const Decimal& d) { return static_cast<double>(d.digits) / pow10_double[d.decimals]; }
+};
+
+/*
+Prices and quantities as int64_t multiples of the symbol's tick and lot size, so level identity is an exact integer
+compare and the SIMD kernels compare 64-bit integers instead of doubles. There are no floating-point compares left on
+the hot path, so this mode doesn't depend on what -ffast-math does to them.
+Binance tick and lot sizes are powers of ten, so they are given as decimal places, e.g. BTCUSDT is
+FixedPointPricing{ 2, 5 } for a 0.01 tick and 0.00001 lot. Converting back divides by an exact power of ten, which
+gives the double closest to the decimal string, ie the same value strtod would have produced for it.
+*/
+struct FixedPointPricing
+{
+    struct Level
+    {
+        int64_t price{};
+        int64_t quantity{};
+
+        auto operator<=>(const Level&) const = default;
+    };
+
+    FixedPointPricing() = default; // Binance sends 8 decimal places for everything, so that's always exact
+    FixedPointPricing(int price_decimals, int quantity_decimals)
+        : price_decimals(price_decimals), quantity_decimals(quantity_decimals),
+          price_scale(pow10_double[price_decimals]), quantity_scale(pow10_double[quantity_decimals]) {}
+
+    Level to_level(const PriceQuantity& pq) const
+    {
+        return { std::llround(pq.price * price_scale), std::llround(pq.quantity * quantity_scale) };
+    }
+    // Straight from the wire digits to ticks/lots with integer arithmetic only. Digits finer than the tick/lot size
+    // are zeros for well-formed data, so the division is exact.
+    Level to_level(const Decimal& price, const Decimal& quantity) const
+    {
+        return { rescale(price, price_decimals), rescale(quantity, quantity_decimals) };
+    }
+    PriceQuantity to_decimal(const Level& level) const
+    {
+        return { static_cast<double>(level.price) / price_scale, static_cast<double>(level.quantity) / quantity_scale };
+    }
+    static bool same_price(int64_t a, int64_t b) { return a == b; }
+
+    int price_decimals = 8;
+    int quantity_decimals = 8;
+    double price_scale = 1e8;
+    double quantity_scale = 1e8;
+
+private:
+    static int64_t rescale(const Decimal& d, int decimals)
+    {
+        const auto digits = static_cast<int64_t>(d.digits);
+        return d.decimals >= decimals ? digits / pow10_int[d.decimals - decimals] : digits * pow10_int[decimals - d.decimals];
+    }
+};
+
+// A bookTicker message (see above) once parsed. Level is normally the book's own level type, so the parser can hand
+// fixed-point books ticks directly.
+template <typename Level = PriceQuantity>
+struct BasicBookTicker
+{
+    uint64_t update_id{}; // "u"
+    Level bid{};          // "b", "B"
+    Level ask{};          // "a", "A"
+};
+
+using BookTicker = BasicBookTicker<>;
+
+// How apply_bbo_batch() treats a burst of tickers
+enum class BboBatchMode
+{
+    Exact,     // Same book as applying them one by one
+    Conflated, // Only the final top of book matters
+};
+
+// Outcome of a sequenced apply_delta()
+enum class DeltaResult
+{
+    Applied,
+    Stale, // Already covered by the snapshot or an earlier update, dropped
+    Gap,   // Updates were missed since the last one applied. Dropped, the book needs a new snapshot.
+};
+
+// One level that differs between the book before and after a replace()
+enum class LevelChangeKind : uint8_t
+{
+    Inserted,        // New price
+    Removed,         // Price no longer in the book
+    QuantityChanged, // Same price, different quantity
+};
+
+template <typename Level>
+struct LevelChange
+{
+    LevelChangeKind kind{};
+    uint32_t index = 0; // Position on its side after the replace(), or before it for a removed level
+    Level level{};      // The level as it is now, or as it was for a removed level
+    decltype(Level::quantity) previous_quantity{}; // QuantityChanged only
+};
+
+/*
+What a replace() changed, for consumers that only want to redo work for levels that moved.
+Filled in by the replace() overloads that take one, in a single merge pass over the old and new sides. Each side's
+changes are in price order, best first, and a side can't have more than 2n (all n levels replaced). Fixed capacity
+so it can be kept and reused by the caller without allocating; the book clears it on every call.
+*/
+template <typename Level, size_t n>
+struct BookChangeSet
+{
+    std::array<LevelChange<Level>, 2 * n> bid_changes{}, ask_changes{};
+    size_t bid_count = 0, ask_count = 0;
+    bool bid_top_changed = false; // Best bid price or quantity changed, or a side became (non-)empty
+    bool ask_top_changed = false;
+
+    std::span<const LevelChange<Level>> bids() const { return { bid_changes.data(), bid_count }; }
+    std::span<const LevelChange<Level>> asks() const { return { ask_changes.data(), ask_count }; }
+    bool top_changed() const { return bid_top_changed || ask_top_changed; }
+    bool empty() const { return bid_count == 0 && ask_count == 0; }
+
+    void clear()
+    {
+        bid_count = ask_count = 0;
+        bid_top_changed = ask_top_changed = false;
+    }
+};
+
+/*
+What replace() accepts as a level: a PriceQuantity, the book's own Level type (e.g. fixed-point ticks), or any
+two-element tuple-like of (price, quantity) such as std::pair<double, double> or std::array<double, 2>.
+*/
+template <typename T, typename Level>
+concept BookLevel = std::is_same_v<std::remove_cvref_t<T>, Level>
+    || std::is_convertible_v<T, PriceQuantity>
+    || requires { requires std::tuple_size<std::remove_cvref_t<T>>::value == 2; };
+
+template <typename R, typename Level>
+concept LevelRange = std::ranges::input_range<R> && BookLevel<std::ranges::range_reference_t<R>, Level>;
+
+/*
+Non-owning, read-only view of one side of a book, best level first.
+Levels aren't necessarily stored as contiguous PriceQuantity (the ring wraps, SoaSide splits the arrays, fixed-point
+levels are ticks), so instead of a std::span this indexes into the side and converts each level as it's read.
+It's two pointers, never copies the book and never allocates. Like a span it's invalidated by the next book update.
+*/
+template <typename Side, typename Pricing>
+class SideView
+{
+public:
+    class iterator
+    {
+    public:
+        using iterator_concept = std::random_access_iterator_tag;
+        using iterator_category = std::input_iterator_tag; // Dereferences to a value, not a reference
+        using value_type = PriceQuantity;
+        using difference_type = std::ptrdiff_t;
+
+        iterator() = default;
+        iterator(const SideView* view, size_t index) : view(view), index(index) {}
+
+        PriceQuantity operator*() const { return (*view)[index]; }
+        PriceQuantity operator[](difference_type d) const { return (*view)[index + d]; }
+
+        iterator& operator++() { ++index; return *this; }
+        iterator operator++(int) { auto copy = *this; ++index; return copy; }
+        iterator& operator--() { --index; return *this; }
+        iterator operator--(int) { auto copy = *this; --index; return copy; }
+        iterator& operator+=(difference_type d) { index += d; return *this; }
+        iterator& operator-=(difference_type d) { index -= d; return *this; }
+        friend iterator operator+(iterator it, difference_type d) { return it += d; }
+        friend iterator operator+(difference_type d, iterator it) { return it += d; }
+        friend iterator operator-(iterator it, difference_type d) { return it -= d; }
+        friend difference_type operator-(const iterator& a, const iterator& b)
+        {
+            return static_cast<difference_type>(a.index) - static_cast<difference_type>(b.index);
+        }
+
+        bool operator==(const iterator& other) const { return index == other.index; }
+        auto operator<=>(const iterator& other) const { return index <=> other.index; }
+
+    private:
+        const SideView* view = nullptr;
+        size_t index = 0;
+    };
+
+    SideView(const Side& side, const Pricing& pricing) : side(&side), pricing(&pricing) {}
+
+    size_t size() const { return side->size(); }
+    bool empty() const { return side->empty(); }
+
+    PriceQuantity operator[](size_t i) const { return pricing->to_decimal((*side)[i]); }
+    PriceQuantity front() const { return (*this)[0]; }
+
+    iterator begin() const { return { this, 0 }; }
+    iterator end() const { return { this, size() }; }
+
+private:
+    const Side* side;
+    const Pricing* pricing;
+};
+
+// The policies a book is built from, see BookTraits.hpp
+// Storage selects the per-side level container, see SideStorage.hpp
+// Pricing selects how prices and quantities are stored, see above
+// Listener is told about changes as they happen, see BookListener.hpp
+// Uncross decides whether crossed levels go straight away or wait for the feed to remove them
+template <size_t n, template <typename, size_t> class Storage = RingSide, typename Pricing = FloatingPointPricing,
+          typename Listener = NullListener, typename Uncross = DropCrossed>
+struct BookTraits
+{
+    static constexpr size_t depth = n;
+    using PricingPolicy = Pricing;
+    using Level = typename Pricing::Level;
+    using Price = decltype(Level::price);
+    using SideStorage = Storage<Level, n>;
+    using ListenerPolicy = Listener;
+    using UncrossPolicy = Uncross;
+};
+
+template <BookTraitsType Traits>
+class BasicBinanceBook final
 {
     friend class Tests; // So I can run the tests
 
+    static constexpr size_t n = Traits::depth;
+    using Pricing = typename Traits::PricingPolicy;
+    using Listener = typename Traits::ListenerPolicy;
+
 public:
-    BinanceBook() = default;
-    BinanceBook(const BinanceBook&) = delete;
-    BinanceBook(BinanceBook&&) = delete;
-    BinanceBook& operator=(const BinanceBook&) = delete;
-    BinanceBook& operator=(const BinanceBook&&) = delete;
+    using Level = typename Traits::Level;
+
+    // Levels are stored inline in the book (a ring buffer per side by default), so it never touches the heap
+    using Side = typename Traits::SideStorage;
+
+    using UncrossPolicy = typename Traits::UncrossPolicy;
+
+    static constexpr size_t max_depth = n;
+
+    using ChangeSet = BookChangeSet<Level, n>;
+
+    using PricingPolicy = Pricing;
+    const Pricing& pricing_policy() const { return pricing; }
+
+    BasicBinanceBook() { orient_sides(); }
+    explicit BasicBinanceBook(const Pricing& book_pricing) : pricing(book_pricing) { orient_sides(); }
+    BasicBinanceBook(const Pricing& book_pricing, const Listener& book_listener) : pricing(book_pricing), listener(book_listener)
+    {
+        orient_sides();
+    }
+
+    // The listener policy (see BookListener.hpp), to read whatever state it keeps
+    Listener& listener_policy() { return listener; }
+    const Listener& listener_policy() const { return listener; }
+    BasicBinanceBook(const BasicBinanceBook&) = delete;
+    BasicBinanceBook(BasicBinanceBook&&) = delete;
+    BasicBinanceBook& operator=(const BasicBinanceBook&) = delete;
+    BasicBinanceBook& operator=(const BasicBinanceBook&&) = delete;
 
     // Clear the book
     // clear()
 
     void clear()
     {
-        bids.clear();
-        asks.clear();
+        notify_top([&] {
+            report_front<BidSide>(bids.size());
+            report_front<AskSide>(asks.size());
+            bids.clear();
+            asks.clear();
+        });
+        bid_horizon = ask_horizon = {};
     }
 
     // Test whether book is empty.
     // bool is_empty()
-    bool is_empty() const { return extract().first[0].price == 0.0 && extract().second[0].price == 0.0; }
+    bool is_empty() const { return bids.empty() && asks.empty(); }
 
     // Replace entire contents of book with given bids / asks (assumed to be in canonical order).
     // Assumes the inputs are already sorted and valid
-    // Bonus: accept any suitable container of PriceQuantity
     // replace(bids, asks)
-    void replace(const std::vector<PriceQuantity>& new_bids, const std::vector<PriceQuantity>& new_asks) {
-        bids = new_bids;
-        asks = new_asks;
+    // Accepts any input range of levels (see BookLevel): vectors (lvalue or rvalue), std::array, spans over a parser's
+    // stack buffer, ranges of (price, quantity) pairs/tuples, or lazily generated views. Each level is converted and
+    // written straight into the side storage, there's no intermediate container.
+    // Anything beyond depth n is dropped, and the input is only read that far.
+    // The default template arguments let `{}` and `{ {price, qty}, ... }` be passed directly.
+    template <typename BidRange = std::initializer_list<PriceQuantity>, typename AskRange = std::initializer_list<PriceQuantity>>
+        requires LevelRange<BidRange, Level> && LevelRange<AskRange, Level>
+    void replace(BidRange&& new_bids, AskRange&& new_asks) {
+        notify_top([&] {
+            if constexpr (Listener::enabled) {
+                // Only a listener needs the old levels, to report what the snapshot changed once it's in
+                const Side previous_bids = bids;
+                const Side previous_asks = asks;
+                load_side<BidSide>(new_bids);
+                load_side<AskSide>(new_asks);
+                report_replaced<BidSide>(previous_bids);
+                report_replaced<AskSide>(previous_asks);
+            }
+            else {
+                load_side<BidSide>(new_bids);
+                load_side<AskSide>(new_asks);
+            }
+        });
+    }
+
+    // Same, and record what changed in changes (see BookChangeSet). The previous sides are copied to diff against,
+    // so this costs a little more than the plain replace(); only worth it when the consumer uses the change set.
+    template <typename BidRange = std::initializer_list<PriceQuantity>, typename AskRange = std::initializer_list<PriceQuantity>>
+        requires LevelRange<BidRange, Level> && LevelRange<AskRange, Level>
+    void replace(BidRange&& new_bids, AskRange&& new_asks, ChangeSet& changes)
+    {
+        changes.clear();
+        const Side previous_bids = bids;
+        const Side previous_asks = asks;
+        replace(new_bids, new_asks);
+        diff_side<BidSide>(previous_bids, bids, [&](const LevelChange<Level>& change) {
+            changes.bid_changes[changes.bid_count++] = change;
+        });
+        diff_side<AskSide>(previous_asks, asks, [&](const LevelChange<Level>& change) {
+            changes.ask_changes[changes.ask_count++] = change;
+        });
+        changes.bid_top_changed = !same_level(top_of(previous_bids), top_of(bids));
+        changes.ask_top_changed = !same_level(top_of(previous_asks), top_of(asks));
     }
 
     // Apply a new best bid / ask.
@@ -152,101 +494,920 @@ public:
     void update_bbo(const PriceQuantity& newbbid, const PriceQuantity& newbask)
     {
         // Update the top of the book and infer any changes needed.
-        new_best_bid(newbbid);
-        new_best_ask(newbask);
+        notify_top([&] {
+            new_best_bid(newbbid);
+            new_best_ask(newbask);
+        });
+    }
+
+    // Same as above for callers that already have levels in the book's representation (e.g. fixed-point ticks)
+    void update_bbo(const Level& newbbid, const Level& newbask) requires (!std::is_same_v<Level, PriceQuantity>)
+    {
+        apply_top(newbbid, newbask);
+    }
+
+    /*
+    Apply a diff-depth update ("depthUpdate" "b"/"a" arrays): each level is the new absolute quantity at its price,
+    and a zero quantity removes the level. Levels can land anywhere in the book, not just at the top.
+    Each level is found with count_better() (binary search or SIMD), then updated in place, erased or inserted,
+    shifting at most half the side. A level that crosses the other side removes the levels it crosses, same as a BBO
+    update, so the book stays uncrossed even if the stream and book briefly disagree.
+
+    The book only holds the best n levels a side, so it can't know everything beyond them: once a side has been
+    full (a snapshot of n or more levels, or an insert that pushed the worst level out) levels worse than its last
+    one may be missing. Deleting levels then leaves the side short rather than pulling in levels it can't know about,
+    and only levels up to that horizon are appended. A fresh snapshot refills it.
+    */
+    template <typename BidRange = std::initializer_list<PriceQuantity>, typename AskRange = std::initializer_list<PriceQuantity>>
+        requires LevelRange<BidRange, Level> && LevelRange<AskRange, Level>
+    void apply_delta(BidRange&& changed_bids, AskRange&& changed_asks)
+    {
+        notify_top([&] {
+            for (const auto& level : changed_bids)
+                apply_level<BidSide>(to_level(level));
+            for (const auto& level : changed_asks)
+                apply_level<AskSide>(to_level(level));
+        });
+    }
+
+    /*
+    Sequenced diff-depth update covering ids [first_update_id, last_update_id] ("U" and "u").
+    Diffs are their own sequence: applied if it continues from the last snapshot or diff applied,
+    first_update_id <= last + 1 <= u. A bookTicker in between doesn't count, it only moves the top of book, so a
+    diff that starts before a ticker's id still has levels the book hasn't seen. Already covered diffs are Stale, as
+    with the other sequenced calls. If first_update_id is past last + 1 something was missed in between: the update
+    is dropped, counted in sequence_stats().gaps, and every diff after it is a Gap too, whatever its ids, until a
+    snapshot is applied with the sequenced replace().
+    */
+    template <typename BidRange = std::initializer_list<PriceQuantity>, typename AskRange = std::initializer_list<PriceQuantity>>
+        requires LevelRange<BidRange, Level> && LevelRange<AskRange, Level>
+    DeltaResult apply_delta(uint64_t first_update_id, uint64_t last_update_id, BidRange&& changed_bids, AskRange&& changed_asks)
+    {
+        if (last_update_id <= last_diff_id) [[unlikely]] {
+            ++(last_update_id <= snapshot_id ? stats.stale : stats.out_of_order);
+            return DeltaResult::Stale;
+        }
+        if (gapped || first_update_id > last_diff_id + 1) [[unlikely]] {
+            gapped = true;
+            ++stats.gaps;
+            return DeltaResult::Gap;
+        }
+        last_diff_id = last_update_id;
+        last_id = std::max(last_id, last_update_id);
+        ++stats.applied;
+        apply_delta(changed_bids, changed_asks);
+        return DeltaResult::Applied;
+    }
+
+    /*
+    Sequenced updates, for when the messages' "lastUpdateId"/"u" fields are available.
+    Update ids only move forward: anything at or before the last applied id is dropped in O(1) before touching the
+    book, and counted in sequence_stats(). Without this a bookTicker that's older than the snapshot we just installed
+    would still uncross the book and erase levels that are valid, until the next snapshot rebuilt them.
+    Returns whether the update was applied.
+    */
+    template <typename BidRange = std::initializer_list<PriceQuantity>, typename AskRange = std::initializer_list<PriceQuantity>>
+        requires LevelRange<BidRange, Level> && LevelRange<AskRange, Level>
+    bool replace(uint64_t update_id, BidRange&& new_bids, AskRange&& new_asks)
+    {
+        if (!accept_snapshot(update_id))
+            return false;
+        replace(new_bids, new_asks);
+        return true;
+    }
+
+    // A stale snapshot leaves changes empty
+    template <typename BidRange = std::initializer_list<PriceQuantity>, typename AskRange = std::initializer_list<PriceQuantity>>
+        requires LevelRange<BidRange, Level> && LevelRange<AskRange, Level>
+    bool replace(uint64_t update_id, BidRange&& new_bids, AskRange&& new_asks, ChangeSet& changes)
+    {
+        if (!accept_snapshot(update_id)) {
+            changes.clear();
+            return false;
+        }
+        replace(new_bids, new_asks, changes);
+        return true;
+    }
+
+    bool update_bbo(uint64_t update_id, const PriceQuantity& newbbid, const PriceQuantity& newbask)
+    {
+        if (!accept_update(update_id))
+            return false;
+        update_bbo(newbbid, newbask);
+        return true;
+    }
+
+    bool update_bbo(const BasicBookTicker<Level>& ticker)
+    {
+        if (!accept_update(ticker.update_id))
+            return false;
+        apply_top(ticker.bid, ticker.ask);
+        return true;
+    }
+
+    /*
+    Apply a burst of bookTickers for this symbol, in order. Each goes through the same update id sequencing as
+    update_bbo(ticker), so sequence_stats() ends up the same either way.
+     - Exact: a run of tickers with the same bid and ask prices only changes the quantities after the first one, so
+       only the last of the run is applied. The book ends up identical to applying every ticker.
+     - Conflated: only the last ticker that passes sequencing is applied, after uncrossing each side once against
+       the highest bid and lowest ask the batch had. So the levels an earlier, more aggressive ticker would have
+       uncrossed go too, and the top of book is exact (unless that ticker is itself crossed). What an earlier
+       ticker's own levels would have done on their side is skipped: Exact can leave them, or drop levels behind
+       them, until a later ticker or the next snapshot replaces them.
+    Returns the number of tickers that were folded into a later one instead of being applied (stale ones aren't
+    counted, they're in sequence_stats()).
+    */
+    size_t apply_bbo_batch(std::span<const BasicBookTicker<Level>> tickers, BboBatchMode mode = BboBatchMode::Exact)
+    {
+        const BasicBookTicker<Level>* pending = nullptr;
+        const Level* highest_bid = nullptr;
+        const Level* lowest_ask = nullptr;
+        size_t coalesced = 0;
+        for (const auto& ticker : tickers) {
+            if (!accept_update(ticker.update_id))
+                continue;
+            // Same guard as update_side(), a level it would reject doesn't uncross anything
+            if (ticker.bid.price > 0 && (highest_bid == nullptr || BidSide::better(ticker.bid.price, highest_bid->price)))
+                highest_bid = &ticker.bid;
+            if (ticker.ask.price > 0 && (lowest_ask == nullptr || AskSide::better(ticker.ask.price, lowest_ask->price)))
+                lowest_ask = &ticker.ask;
+            if (pending != nullptr) {
+                if (mode == BboBatchMode::Conflated || same_prices(*pending, ticker)) {
+                    ++coalesced;
+                }
+                else {
+                    apply_top(pending->bid, pending->ask);
+                }
+            }
+            pending = &ticker;
+        }
+        if (pending == nullptr)
+            return coalesced;
+        if (mode == BboBatchMode::Conflated && coalesced > 0) {
+            notify_top([&] {
+                if (highest_bid != nullptr)
+                    uncross<BidSide>(*highest_bid);
+                if (lowest_ask != nullptr)
+                    uncross<AskSide>(*lowest_ask);
+                update_side<BidSide>(pending->bid);
+                update_side<AskSide>(pending->ask);
+            });
+        }
+        else {
+            apply_top(pending->bid, pending->ask);
+        }
+        return coalesced;
     }
 
+    struct SequenceStats
+    {
+        uint64_t applied = 0;      // Sequenced updates applied
+        uint64_t stale = 0;        // Dropped, not newer than the installed snapshot
+        uint64_t out_of_order = 0; // Dropped, newer than the snapshot but older than an update already applied
+        uint64_t gaps = 0;         // Diff-depth updates dropped because earlier ones were missed
+    };
+
+    const SequenceStats& sequence_stats() const { return stats; }
+
+    // What update_side() has been doing, all zero unless built with BINANCEBOOK_COUNTERS (see BookCounters.hpp).
+    // Safe to call from any thread while the book is being updated.
+    static constexpr bool counters_enabled = BookCountersType::enabled;
+    BookCounterValues counter_values() const { return counters.values(); }
+    uint64_t last_update_id() const { return last_id; }
+    uint64_t snapshot_update_id() const { return snapshot_id; }
+    uint64_t diff_update_id() const { return last_diff_id; }
+    bool gap_pending() const { return gapped; }
+
     // Retrieve the book (in canonical order).
     // This should output something similar to the input for `replace()`.
     // extract()
     // Retrieve the current state of the book in canonical order
+    // This copies into two new vectors, readers on the hot path should use the views / extract_into below instead.
     std::pair<std::vector<PriceQuantity>, std::vector<PriceQuantity>> extract() const {
-        return { bids, asks };
+        std::pair<std::vector<PriceQuantity>, std::vector<PriceQuantity>> result;
+        result.first.resize(bids.size());
+        result.second.resize(asks.size());
+        extract_into(result.first, result.second);
+        return result;
     }
 
-    // to_string() - convert to string for output.
-    // This should be efficient but isn't performance critical.
-    std::string to_string() const
+    // Zero-copy read access, see SideView. Valid until the next update to the book.
+    using View = SideView<Side, Pricing>;
+    View bid_view() const { return { bids, pricing }; }
+    View ask_view() const { return { asks, pricing }; }
+
+    std::optional<PriceQuantity> best_bid() const { return bids.empty() ? std::nullopt : std::optional(pricing.to_decimal(bids.front())); }
+    std::optional<PriceQuantity> best_ask() const { return asks.empty() ? std::nullopt : std::optional(pricing.to_decimal(asks.front())); }
+
+    // Number of { bid, ask } levels currently in the book, each at most n
+    std::pair<size_t, size_t> depth() const { return { bids.size(), asks.size() }; }
+
+    /*
+    Depth analytics. With an AnalyticSide storage (see DepthAnalytics.hpp) the sums are maintained as the book
+    changes, so bid_depth/ask_depth/imbalance are O(1) and the fill estimates O(log n). Other storages get the same
+    answers from a walk over the levels involved.
+    */
+
+    // Quantity-weighted mid, leaning towards the side with less quantity at the top
+    std::optional<double> microprice() const
+    {
+        if (bids.empty() || asks.empty())
+            return std::nullopt;
+        const PriceQuantity bid = pricing.to_decimal(bids.front()), ask = pricing.to_decimal(asks.front());
+        return (bid.price * ask.quantity + ask.price * bid.quantity) / (bid.quantity + ask.quantity);
+    }
+
+    // (bid quantity - ask quantity) / (bid quantity + ask quantity) over the best k levels a side, in [-1, 1]
+    std::optional<double> imbalance(size_t k = 1) const
+    {
+        const double bid = bid_depth(k).quantity, ask = ask_depth(k).quantity;
+        if (bid + ask <= 0)
+            return std::nullopt;
+        return (bid - ask) / (bid + ask);
+    }
+
+    // Total quantity and notional (price * quantity) of the best k levels
+    DepthSum bid_depth(size_t k) const { return side_depth(bids, k); }
+    DepthSum ask_depth(size_t k) const { return side_depth(asks, k); }
+
+    struct FillEstimate
+    {
+        double quantity = 0;      // What the side can fill, at most the quantity asked for
+        double notional = 0;
+        double average_price = 0; // notional / quantity, 0 if nothing fills
+        double worst_price = 0;   // Price of the last level touched
+        size_t levels = 0;        // Levels touched, the last one maybe partly
+    };
+
+    // Walking the book for a market order of quantity: buys take the asks, sells take the bids
+    FillEstimate cost_to_buy(double quantity) const { return estimate_fill(asks, quantity); }
+    FillEstimate cost_to_sell(double quantity) const { return estimate_fill(bids, quantity); }
+
+    // Copy the book into caller-owned buffers, as many levels as fit. Returns the number of { bid, ask } levels written.
+    std::pair<size_t, size_t> extract_into(std::span<PriceQuantity> out_bids, std::span<PriceQuantity> out_asks) const
+    {
+        const size_t bid_count = std::min(bids.size(), out_bids.size());
+        const size_t ask_count = std::min(asks.size(), out_asks.size());
+        for (size_t i = 0; i < bid_count; ++i)
+            out_bids[i] = pricing.to_decimal(bids[i]);
+        for (size_t i = 0; i < ask_count; ++i)
+            out_asks[i] = pricing.to_decimal(asks[i]);
+        return { bid_count, ask_count };
+    }
+
+    /*
+    Render the book in the layout documented above, one line per level:
+        [ 1] [ 0.00431] 20078.54000000 | 20078.91000000 [0.03497   ]
+    Quantities are printed with up to quantity_precision decimals, trailing zeros trimmed, padded so the price
+    columns line up. Prices always get price_precision decimals, so they line up too.
+    */
+    // Longest line format_to() can produce: two 16 digit quantities, two prices in general form at worst, and padding
+    static constexpr size_t max_line_length = 256;
+    // And the most it can write for a whole book, one line per level
+    static constexpr size_t max_format_length = n * max_line_length;
+
+    struct FormatOptions
+    {
+        int price_precision = 8;
+        int quantity_precision = 8;
+        size_t top_k = n; // Only the best top_k levels of each side
+    };
+
+    // Render into out one line at a time, without touching the heap
+    template <std::output_iterator<char> Out>
+    Out format_to(Out out, const FormatOptions& options = {}) const
     {
-        /*
-        std::ostringstream is relatively slow because it manages a dynamic buffer and performs
-        frequent reallocations. Instead, we can use std::string with reserve() to pre-allocate sufficient
-        memory, reducing reallocations and improving performance.
-        */
+        render(options, [&out](const char* line, size_t length) {
+            out = std::copy(line, line + length, out);
+            return true;
+        });
+        return out;
+    }
+
+    // Render into [buffer, buffer + capacity). Returns the number of chars written (nothing is NUL terminated), or
+    // nullopt if it doesn't fit, in which case the buffer holds the lines that did.
+    std::optional<size_t> format_to(char* buffer, size_t capacity, const FormatOptions& options = {}) const
+    {
+        size_t written = 0;
+        const bool fits = render(options, [&](const char* line, size_t length) {
+            if (capacity - written < length)
+                return false;
+            std::memcpy(buffer + written, line, length);
+            written += length;
+            return true;
+        });
+        return fits ? std::optional(written) : std::nullopt;
+    }
 
-        //Pre-calculate the expected size to reduce allocations
-        size_t estimated_size = std::max(bids.size(), asks.size()) * 80; // Rough estimation per line
+    // to_string() - convert to string for output.
+    // This should be efficient but isn't performance critical. The string is sized up front, so this is the only
+    // allocation.
+    std::string to_string(const FormatOptions& options = {}) const
+    {
         std::string result;
-        result.reserve(estimated_size);
+        result.reserve(std::min(std::max(bids.size(), asks.size()), options.top_k) * 64);
+        format_to(std::back_inserter(result), options);
+        return result;
+    }
+
+private:
+    /*
+    side A and side B distinction so we can deal with "crossing" values
+    side A is the BookSide (BidSide or AskSide, see BookTraits.hpp) getting the new top and side B the other one
+    BookSide decides which way the comparators go as canonicity is reversed for bids vs asked, at compile time, so
+    the bid and ask versions are separate functions with no is_bid branches left in them
+    */
+    template <typename BookSide>
+    inline void update_side(const Level& new_top)
+    {
+        Side& sideA = side_of<BookSide>();
+
+        if (new_top.price <= 0) [[unlikely]] { // For Testing
+            counters.on_rejected();
+            return;
+        }
 
-        size_t max_size = std::max(bids.size(), asks.size());
+        // Everything below only feeds the counters, and compiles away with them (see BookCounters.hpp)
+        uint64_t sample_start = 0;
+        const bool sampled = counters.start_sample(sample_start);
+        SideUpdateEvent event;
+
+        // Everything before our BEST bid/ask is erased because if the new one is now the best, the previously "better"
+        // ones must not be valid anymore or have already been fulfilled. Those are exactly the levels before the
+        // lower_bound position, so it's a prefix drop which the storage does in O(1).
+        const size_t better = sideA.count_better(new_top.price, BookSide::is_bid);
+        report_front<BookSide>(better);
+        sideA.drop_front(better);
+
+        // If the price exists it is now at the front, so update the quantity
+        if (!sideA.empty() && Pricing::same_price(sideA.front().price, new_top.price)) {
+            if constexpr (Listener::enabled) {
+                if (sideA.front().quantity != new_top.quantity) {
+                    sideA.set_front_quantity(new_top.quantity);
+                    report_changed<BookSide>(sideA.front());
+                }
+            }
+            else {
+                sideA.set_front_quantity(new_top.quantity);
+            }
+        }
+        else if constexpr (PriceIndexedStorage<Side>) {
+            event.inserted = true;
+            event.trimmed = put_indexed<BookSide>(new_top, [&](auto& dropped) { return sideA.push_front(new_top, dropped); });
+        }
+        else {
+            // Otherwise it becomes the new front, the storage drops the worst level itself to maintain depth n
+            event.inserted = true;
+            event.trimmed = sideA.size() == n;
+            if (event.trimmed)
+                report_worst<BookSide>();
+            sideA.push_front(new_top);
+            report_changed<BookSide>(new_top);
+            if (event.trimmed)
+                horizon_of<BookSide>() = { true, sideA[n - 1].price };
+        }
+
+        // Remove all sideB that cross the new price, this is fixing the "crossover" issue.
+        // sideB is sorted so the crossed levels are the ones "better" than new_top from sideB's point of view,
+        // which is again a prefix. With KeepCrossed they stay, sideB's own new top will drop them if they're gone.
+        const size_t crossed = uncross<BookSide>(new_top);
+
+        if constexpr (BookCountersType::enabled) {
+            event.prefix_dropped = static_cast<uint32_t>(better);
+            event.uncrossed = static_cast<uint32_t>(crossed);
+            counters.on_update(event);
+            if (sampled)
+                counters.end_sample(sample_start, event);
+        }
+    }
+
+    // Drop the levels on the other side that new_top crosses, returning how many. Nothing with KeepCrossed.
+    template <typename BookSide>
+    size_t uncross(const Level& new_top)
+    {
+        if constexpr (UncrossPolicy::drop_crossed) {
+            Side& sideB = side_of<typename BookSide::Other>();
+            const size_t crossed = sideB.count_better(new_top.price, BookSide::Other::is_bid);
+            report_uncross<BookSide>(crossed, new_top);
+            sideB.drop_front(crossed);
+            return crossed;
+        }
+        else {
+            return 0;
+        }
+    }
+
+    // Format each line into a stack buffer and hand it to emit(line, length), stopping if emit returns false
+    template <typename Emit>
+    bool render(const FormatOptions& options, Emit&& emit) const
+    {
+        const int price_precision = std::clamp(options.price_precision, 0, 17);
+        const int quantity_precision = std::clamp(options.quantity_precision, 0, 17);
+        const size_t rows = std::min(std::max(bids.size(), asks.size()), options.top_k);
+        const int quantity_width = quantity_precision + 2;
+        const int index_width = rows >= 100 ? 3 : 2;
+        size_t bid_cell_width = 0; // To pad rows where the bids have run out
+
+        char line[max_line_length];
+        for (size_t i = 0; i < rows; ++i) {
+            char* p = line;
+            char* const last = line + max_line_length;
 
-        for (size_t i = 0; i < max_size; ++i) {
             if (i < bids.size()) {
-                result += '[' + std::to_string(i + 1) + "] [";
-                result += format_double(bids[i].quantity, 8) + "] ";
-                result += format_double(bids[i].price, 8) + " | ";
+                const PriceQuantity bid = pricing.to_decimal(bids[i]);
+                char quantity[32];
+                const char* quantity_end = format_double_to(quantity, quantity + sizeof(quantity), bid.quantity, quantity_precision, true);
+                const auto quantity_length = static_cast<int>(quantity_end - quantity);
+
+                *p++ = '[';
+                p = pad_to(p, index_width - digits(i + 1));
+                p = std::to_chars(p, last, i + 1).ptr;
+                *p++ = ']';
+                *p++ = ' ';
+                *p++ = '[';
+                p = pad_to(p, quantity_width - quantity_length);
+                p = std::copy(quantity, quantity + quantity_length, p);
+                *p++ = ']';
+                *p++ = ' ';
+                p = format_double_to(p, p + 40, bid.price, price_precision);
+                bid_cell_width = static_cast<size_t>(p - line);
             }
             else {
-                result += "                      | ";
+                p = pad_to(p, static_cast<int>(bid_cell_width));
             }
 
+            *p++ = ' ';
+            *p++ = '|';
+            *p++ = ' ';
+
             if (i < asks.size()) {
-                result += format_double(asks[i].price, 8) + " [";
-                result += format_double(asks[i].quantity, 8) + "]";
+                const PriceQuantity ask = pricing.to_decimal(asks[i]);
+                p = format_double_to(p, p + 40, ask.price, price_precision);
+                *p++ = ' ';
+                *p++ = '[';
+                char* const quantity = p;
+                p = format_double_to(p, p + 40, ask.quantity, quantity_precision, true);
+                p = pad_to(p, quantity_width - static_cast<int>(p - quantity));
+                *p++ = ']';
+            }
+            else {
+                p -= 1; // No trailing space after the '|'
             }
 
-            result += '\n';
+            *p++ = '\n';
+            if (!emit(line, static_cast<size_t>(p - line)))
+                return false;
         }
+        return true;
+    }
 
-        return result;
+    static char* pad_to(char* p, int count)
+    {
+        for (; count > 0; --count)
+            *p++ = ' ';
+        return p;
+    }
+
+    static int digits(size_t value)
+    {
+        int count = 1;
+        while (value >= 10) {
+            value /= 10;
+            ++count;
+        }
+        return count;
+    }
+
+    // Once a side has been full, levels worse than price may exist that it doesn't hold (see apply_delta)
+    struct Horizon
+    {
+        bool limited = false;
+        typename Side::Price price{};
+    };
+
+    template <typename BookSide>
+    Horizon& horizon_of()
+    {
+        if constexpr (BookSide::is_bid)
+            return bid_horizon;
+        else
+            return ask_horizon;
+    }
+
+    template <typename BookSide>
+    Side& side_of()
+    {
+        if constexpr (BookSide::is_bid)
+            return bids;
+        else
+            return asks;
+    }
+
+    template <typename BookSide>
+    const Side& side_of() const
+    {
+        if constexpr (BookSide::is_bid)
+            return bids;
+        else
+            return asks;
+    }
+
+    // One level of a diff-depth update
+    template <typename BookSide>
+    void apply_level(const Level& level)
+    {
+        if (level.price <= 0) [[unlikely]]
+            return;
+
+        Side& side = side_of<BookSide>();
+        Side& other = side_of<typename BookSide::Other>();
+        Horizon& horizon = horizon_of<BookSide>();
+
+        // Where the level is or would go. A price-indexed storage (LadderSide) finds the price directly in O(1), and
+        // ignores the position when inserting. Everything else searches for the position.
+        size_t i = 0;
+        bool exists, at_back;
+        if constexpr (PriceIndexedStorage<Side>) {
+            const auto existing = side.find(level.price);
+            exists = existing.has_value();
+            if (exists && level.quantity == 0) {
+                if constexpr (Listener::enabled)
+                    listener.on_level_removed(BookSide::is_bid, *existing);
+                side.erase_at(level.price);
+                return;
+            }
+            if (exists) {
+                side.set_quantity_at(level.price, level.quantity);
+                report_changed<BookSide>(level);
+                return;
+            }
+            at_back = side.empty() || BookSide::better(side.back().price, level.price);
+        }
+        else {
+            i = side.count_better(level.price, BookSide::is_bid);
+            exists = i < side.size() && Pricing::same_price(side[i].price, level.price);
+            if (exists && level.quantity == 0) {
+                if constexpr (Listener::enabled)
+                    listener.on_level_removed(BookSide::is_bid, side[i]);
+                side.erase(i);
+                return;
+            }
+            if (exists) {
+                side.set_quantity(i, level.quantity);
+                report_changed<BookSide>(side[i]);
+                return;
+            }
+            at_back = i == side.size();
+        }
+        if (level.quantity == 0)
+            return;
+
+        if (at_back) {
+            // Worse than everything we hold: only known to be the next level if nothing was cut off before it
+            const bool beyond_horizon = horizon.limited && BookSide::better(horizon.price, level.price);
+            if (beyond_horizon)
+                return;
+            if (side.size() == n) {
+                horizon = { true, last_level(side).price }; // This level is now missing behind the last one
+                return;
+            }
+            if constexpr (PriceIndexedStorage<Side>) {
+                put_indexed<BookSide>(level, [&](auto& dropped) { return side.push_back(level, dropped); });
+            }
+            else {
+                side.push_back(level);
+                report_changed<BookSide>(level);
+            }
+        }
+        else if constexpr (PriceIndexedStorage<Side>) {
+            put_indexed<BookSide>(level, [&](auto& dropped) { return side.insert(i, level, dropped); });
+        }
+        else {
+            const bool trims = side.size() == n;
+            if (trims)
+                report_worst<BookSide>();
+            side.insert(i, level);
+            report_changed<BookSide>(level);
+            if (trims)
+                horizon = { true, last_level(side).price };
+        }
+
+        // Levels on the other side at this price or better than it can't exist any more. Unlike a BBO update this
+        // includes the same price, there's no new top for the other side in the same call to replace it.
+        // With KeepCrossed they stay until the diff that deletes them.
+        if constexpr (UncrossPolicy::drop_crossed) {
+            size_t crossed = other.count_better(level.price, BookSide::Other::is_bid);
+            if (crossed < other.size() && Pricing::same_price(other[crossed].price, level.price))
+                ++crossed;
+            report_uncross<BookSide>(crossed, level);
+            other.drop_front(crossed);
+        }
+    }
+
+    void apply_top(const Level& bid, const Level& ask)
+    {
+        notify_top([&] {
+            update_side<BidSide>(bid);
+            update_side<AskSide>(ask);
+        });
     }
 
-private:
     /*
-    side A and side B distinction so we can deal with "crossing" values
-    side A and side B will swap depending on which vector we're reducing
-    is_bid is used to decide which way the comparators go as canonicity is reversed for bids vs asked
+    Put a level in a price-indexed side (LadderSide) with put(dropped). Its window of prices can move under it: levels
+    that fall off the far end are dropped along with the worst one at depth n, and a level past the window isn't held
+    at all. Either way the side is only complete up to its last level from then on, like a side trimmed to n.
+    The storage reports each level it drops before it goes, and level is reported once it's in. Returns whether any
+    were dropped.
     */
-    inline void update_side(std::vector<PriceQuantity>& sideA, std::vector<PriceQuantity>& sideB, const PriceQuantity& new_top, bool is_bid)
+    template <typename BookSide, typename Put>
+    bool put_indexed(const Level& level, Put&& put)
     {
-        // Timer t; // For measuring performance
-        if (new_top.price <= 0) [[unlikely]] // For Testing
-            return;
+        Side& side = side_of<BookSide>();
+        bool lost = false;
+        auto dropped = [&](const Level& level) {
+            lost = true;
+            if constexpr (Listener::enabled)
+                listener.on_level_removed(BookSide::is_bid, level);
+        };
+        const bool held = put(dropped);
+        if (held)
+            report_changed<BookSide>(level);
+        if ((lost || !held) && !side.empty())
+            horizon_of<BookSide>() = { true, side.back().price };
+        return lost;
+    }
 
-        // Find the appropriate position to insert or update the new top price level
-        auto it = std::lower_bound(sideA.begin(), sideA.end(), new_top,
-            [is_bid](const PriceQuantity& a, const PriceQuantity& b) {
-                return is_bid ? a.price > b.price : a.price < b.price;
-            });
+    static Level last_level(const Side& side)
+    {
+        if constexpr (PriceIndexedStorage<Side>)
+            return side.back();
+        else
+            return side[side.size() - 1];
+    }
+
+    // Storages that map prices to slots (LadderSide) need to know which way each side's prices improve
+    void orient_sides()
+    {
+        if constexpr (requires(Side& side) { side.orient(true); }) {
+            bids.orient(BidSide::is_bid);
+            asks.orient(AskSide::is_bid);
+        }
+    }
 
-        // If the price exists, update the quantity
-        if (it != sideA.end() && essentiallyEqual(it->price, new_top.price)) {
-            it->quantity = new_top.quantity;
+    // Sums in the side's raw units, then converted to decimal
+    DepthSum side_depth(const Side& side, size_t k) const
+    {
+        DepthSum sum;
+        if constexpr (DepthAnalyticStorage<Side>) {
+            sum = side.depth(k);
         }
         else {
-            // Otherwise insert the new price level at the correct position
-            it = sideA.insert(it, new_top);
+            for (size_t i = 0; i < std::min(k, side.size()); ++i) {
+                const Level level = side[i];
+                const auto quantity = static_cast<double>(level.quantity);
+                sum += { quantity, static_cast<double>(level.price) * quantity };
+            }
+        }
+        return { sum.quantity / pricing.quantity_scale, sum.notional / (pricing.price_scale * pricing.quantity_scale) };
+    }
+
+    FillEstimate estimate_fill(const Side& side, double quantity) const
+    {
+        FillEstimate fill;
+        if (side.empty() || quantity <= 0)
+            return fill;
+        const double wanted = quantity * pricing.quantity_scale;
+
+        // Levels needed, and what the ones before the last hold
+        size_t k;
+        DepthSum before;
+        if constexpr (DepthAnalyticStorage<Side>) {
+            k = std::min(side.levels_to_fill(wanted), side.size());
+            before = side.depth(k - 1);
+        }
+        else {
+            for (k = 1; k < side.size(); ++k) {
+                const Level level = side[k - 1];
+                const auto level_quantity = static_cast<double>(level.quantity);
+                if (before.quantity + level_quantity >= wanted)
+                    break;
+                before += { level_quantity, static_cast<double>(level.price) * level_quantity };
+            }
+        }
+
+        const Level last = side[k - 1];
+        const double taken = std::min(wanted - before.quantity, static_cast<double>(last.quantity));
+        const DepthSum total = before + DepthSum{ taken, static_cast<double>(last.price) * taken };
+        fill.quantity = total.quantity / pricing.quantity_scale;
+        fill.notional = total.notional / (pricing.price_scale * pricing.quantity_scale);
+        fill.average_price = fill.quantity > 0 ? fill.notional / fill.quantity : 0;
+        fill.worst_price = static_cast<double>(last.price) / pricing.price_scale;
+        fill.levels = k;
+        return fill;
+    }
+
+    // The listener hooks. Each is a no-op for a disabled listener, so none of the loops or copies are compiled in.
+
+    // Run mutate, then tell the listener if it moved the top of book
+    template <typename Mutate>
+    void notify_top(Mutate&& mutate)
+    {
+        if constexpr (Listener::enabled) {
+            const auto bid = top_of(bids), ask = top_of(asks);
+            mutate();
+            const auto new_bid = top_of(bids), new_ask = top_of(asks);
+            if (!same_level(bid, new_bid) || !same_level(ask, new_ask))
+                listener.on_bbo_change(new_bid, new_ask);
+        }
+        else {
+            mutate();
+        }
+    }
+
+    // The first count levels of the side are about to go
+    template <typename BookSide>
+    void report_front(size_t count)
+    {
+        if constexpr (Listener::enabled) {
+            const Side& side = side_of<BookSide>();
+            for (size_t i = 0; i < count; ++i)
+                listener.on_level_removed(BookSide::is_bid, side[i]);
+        }
+    }
+
+    // The side's worst level is about to be pushed out
+    template <typename BookSide>
+    void report_worst()
+    {
+        if constexpr (Listener::enabled)
+            listener.on_level_removed(BookSide::is_bid, last_level(side_of<BookSide>()));
+    }
+
+    // crossing (on BookSide) is about to remove the first count levels of the other side
+    template <typename BookSide>
+    void report_uncross(size_t count, const Level& crossing)
+    {
+        if constexpr (Listener::enabled) {
+            if (count == 0)
+                return;
+            report_front<typename BookSide::Other>(count);
+            listener.on_uncross(BookSide::is_bid, crossing, count);
         }
+    }
+
+    // A level was inserted or its quantity changed, level is how it is now
+    template <typename BookSide>
+    void report_changed(const Level& level)
+    {
+        if constexpr (Listener::enabled)
+            listener.on_level_changed(BookSide::is_bid, level);
+    }
+
+    // What a snapshot did to a side's previous contents: the levels it didn't keep, and the ones it added or changed
+    template <typename BookSide>
+    void report_replaced(const Side& before)
+    {
+        diff_side<BookSide>(before, side_of<BookSide>(), [&](const LevelChange<Level>& change) {
+            if (change.kind == LevelChangeKind::Removed)
+                listener.on_level_removed(BookSide::is_bid, change.level);
+            else
+                listener.on_level_changed(BookSide::is_bid, change.level);
+        });
+    }
+
+    static std::optional<Level> top_of(const Side& side) { return side.empty() ? std::nullopt : std::optional<Level>(side.front()); }
+
+    static bool same_level(const std::optional<Level>& a, const std::optional<Level>& b)
+    {
+        if (!a || !b)
+            return a.has_value() == b.has_value();
+        return Pricing::same_price(a->price, b->price) && a->quantity == b->quantity;
+    }
 
-        // If erase everything before our BEST bid/ask because if the new one is now the best, the previously "better" ones
-        // Must not be valid anymore or have already been fulfilled
-        if (sideA.begin() < it)
-            sideA.erase(sideA.begin(), it);
+    // Once a's been applied, applying b only sets the two front quantities. Prices have to match exactly (not just
+    // same_price()) because the book would keep a's price, and a crossed ticker can uncross its own bid.
+    static bool same_prices(const BasicBookTicker<Level>& a, const BasicBookTicker<Level>& b)
+    {
+        return a.bid.price == b.bid.price && a.ask.price == b.ask.price && a.bid.price < a.ask.price;
+    }
 
-        // Trim the vector size to maintain 20 depth
-        while (sideA.size() > 20)
-            sideA.pop_back(); // Vector pop_back implementation reduces size, not capacity therefore allocating n + 1 saves time
+    // Tickers: newer than anything applied so far
+    bool accept_update(uint64_t update_id)
+    {
+        if (update_id <= last_id) [[unlikely]] {
+            ++(update_id <= snapshot_id ? stats.stale : stats.out_of_order);
+            return false;
+        }
+        last_id = update_id;
+        ++stats.applied;
+        return true;
+    }
 
-        // Remove all sideB that are less than or equal to the new bid price this is fixing the "crossover" issue
-        sideB.erase(std::remove_if(sideB.begin(), sideB.end(), [new_top, is_bid](const PriceQuantity& ask) {
-            return is_bid ? ask.price < new_top.price : ask.price > new_top.price;
-            }), sideB.end());
+    // Snapshots: the same, except that after a gap a ticker applied since doesn't make the snapshot that repairs the
+    // book stale, it only has to be newer than the diffs. Starts the diff sequence again from update_id.
+    bool accept_snapshot(uint64_t update_id)
+    {
+        if (update_id <= (gapped ? last_diff_id : last_id)) [[unlikely]] {
+            ++(update_id <= snapshot_id ? stats.stale : stats.out_of_order);
+            return false;
+        }
+        last_id = std::max(last_id, update_id);
+        last_diff_id = snapshot_id = update_id;
+        gapped = false;
+        ++stats.applied;
+        return true;
     }
 
-    inline void new_best_bid(const PriceQuantity& new_top) { update_side(bids, asks, new_top, /*is_bid=*/true); }
-    inline void new_best_ask(const PriceQuantity& new_top) { update_side(asks, bids, new_top, /*is_bid=*/false); };
+    template <typename BookSide, typename Range>
+    void load_side(Range& levels)
+    {
+        Side& side = side_of<BookSide>();
+        side.clear();
+        auto it = std::ranges::begin(levels);
+        const auto end = std::ranges::end(levels);
+        // A price-indexed side can run out of window before it runs out of depth, the rest isn't held either
+        bool held = true;
+        for (; held && it != end && side.size() < n; ++it) {
+            if constexpr (PriceIndexedStorage<Side>)
+                held = side.push_back(to_level(*it));
+            else
+                side.push_back(to_level(*it));
+        }
+        // A snapshot that fills the side may have been cut off, like Binance's partial depth always is
+        const bool cut_off = side.size() == n || (!held && !side.empty());
+        horizon_of<BookSide>() = cut_off ? Horizon{ true, last_level(side).price } : Horizon{};
+    }
 
-    std::vector<PriceQuantity> bids{ n + 1 }, asks{ n + 1 }; // Allocating n + 1 to minimise speed impact of overflow
+    // Merge walk over two sorted sides, passing the differences to emit in price order
+    template <typename BookSide, typename Emit>
+    static void diff_side(const Side& before, const Side& after, Emit&& emit)
+    {
+        size_t i = 0, j = 0;
+        while (i < before.size() || j < after.size()) {
+            if (j == after.size()) {
+                emit(LevelChange<Level>{ LevelChangeKind::Removed, static_cast<uint32_t>(i), before[i], {} });
+                ++i;
+                continue;
+            }
+            const Level now = after[j];
+            if (i == before.size()) {
+                emit(LevelChange<Level>{ LevelChangeKind::Inserted, static_cast<uint32_t>(j), now, {} });
+                ++j;
+                continue;
+            }
+            const Level was = before[i];
+            if (Pricing::same_price(was.price, now.price)) {
+                if (was.quantity != now.quantity)
+                    emit(LevelChange<Level>{ LevelChangeKind::QuantityChanged, static_cast<uint32_t>(j), now, was.quantity });
+                ++i;
+                ++j;
+            }
+            else if (BookSide::better(was.price, now.price)) {
+                emit(LevelChange<Level>{ LevelChangeKind::Removed, static_cast<uint32_t>(i), was, {} });
+                ++i;
+            }
+            else {
+                emit(LevelChange<Level>{ LevelChangeKind::Inserted, static_cast<uint32_t>(j), now, {} });
+                ++j;
+            }
+        }
+    }
+
+    template <typename T>
+    Level to_level(const T& level) const
+    {
+        if constexpr (std::is_same_v<T, Level>) {
+            return level;
+        }
+        else if constexpr (std::is_convertible_v<const T&, PriceQuantity>) {
+            return pricing.to_level(level);
+        }
+        else {
+            const auto& [price, quantity] = level;
+            return pricing.to_level({ static_cast<Price>(price), static_cast<Quantity>(quantity) });
+        }
+    }
+
+    inline void new_best_bid(const PriceQuantity& new_top) { update_side<BidSide>(pricing.to_level(new_top)); }
+    inline void new_best_ask(const PriceQuantity& new_top) { update_side<AskSide>(pricing.to_level(new_top)); };
+
+    Side bids, asks;
+    [[no_unique_address]] Pricing pricing;
+
+    Horizon bid_horizon, ask_horizon;
+    [[no_unique_address]] BookCountersType counters;
+    [[no_unique_address]] Listener listener;
+
+    uint64_t last_id = 0;      // Newest sequenced update applied, snapshot, BBO or diff
+    uint64_t last_diff_id = 0; // Where the diff sequence is up to: the last snapshot or diff applied
+    uint64_t snapshot_id = 0;  // Last snapshot applied
+    bool gapped = false;       // A diff was missed, nothing but a snapshot gets diffs going again
+    SequenceStats stats;
+
+};
 
-};
\ No newline at end of file
+// BinanceBook<n, Storage, Pricing, Listener, Uncross> is the book for BookTraits with the same arguments
+template <size_t n, template <typename, size_t> class Storage = RingSide, typename Pricing = FloatingPointPricing,
+          typename Listener = NullListener, typename Uncross = DropCrossed>
+using BinanceBook = BasicBinanceBook<BookTraits<n, Storage, Pricing, Listener, Uncross>>;
\ No newline at end of file
@@ -0,0 +1,595 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <limits>
+#include <ranges>
+#include <span>
+#include <string_view>
+#include <type_traits>
+
+#include "BinanceBook.hpp"
+#include "util.hpp"
+
+/*
+Parser for the Binance messages documented in BinanceBook.hpp, partial book depth and bookTicker, and for the
+diff-depth stream's depthUpdate events.
+
+They all have a fixed shape so there's no need for a general JSON library. It's a single forward pass over the input
+buffer: decimal strings are read digit by digit into a Decimal (no strtod, no locale, no std::string), and the
+depth levels are collected in a fixed-size array. Applying a message converts those Decimals straight into the book's
+level type (doubles or fixed-point ticks) as replace()/update_bbo() read them, so nothing is allocated or copied
+into an intermediate container.
+A depthUpdate can carry any number of levels, so its arrays are only validated during the parse and kept as slices
+of the buffer; applying it parses them a second time, level by level, straight into apply_delta(). Snapshots for deep
+books are handled the same way (RawDepthMessage), since a DepthMessage for thousands of levels is too big for the stack.
+Unknown keys are skipped, so the extra fields other stream variants carry ("e", "E", "T", ...) don't break it.
+Like the book, it assumes the input is well-formed. It will never read past the end of the buffer though,
+malformed input just makes the parse report failure.
+*/
+
+enum class MessageType : uint8_t
+{
+    Unknown,
+    Depth,
+    BookTicker,
+    DepthUpdate,
+};
+
+// A level with both fields still in wire form
+struct DecimalLevel
+{
+    Decimal price{};
+    Decimal quantity{};
+};
+
+// {"lastUpdateId":...,"bids":[["price","qty"],...],"asks":[...]}
+// Only the first n levels of each side are kept, the rest are parsed over.
+template <size_t n>
+struct DepthMessage
+{
+    uint64_t update_id{};
+    std::array<DecimalLevel, n> bids{}, asks{};
+    size_t bid_count = 0, ask_count = 0;
+};
+
+// {"u":...,"s":"BTCUSDT","b":"...","B":"...","a":"...","A":"..."}
+struct TickerMessage
+{
+    uint64_t update_id{};
+    std::string_view symbol; // Points into the input buffer
+    DecimalLevel bid{}, ask{};
+};
+
+// A depth snapshot with its level arrays kept unparsed, see DecimalLevels. What handle_message() uses for deep books.
+struct RawDepthMessage
+{
+    uint64_t update_id{};
+    std::string_view bids, asks; // The [[...],...] arrays, pointing into the input buffer
+};
+
+// Above this a DepthMessage is too big to parse into on the stack (n = 256 at 32 bytes a level)
+inline constexpr size_t max_stack_depth_message = 16 * 1024;
+
+// {"e":"depthUpdate","E":...,"s":"BNBBTC","U":157,"u":160,"b":[["price","qty"],...],"a":[...]}
+// The level arrays are kept unparsed, see DecimalLevels
+struct DepthUpdateMessage
+{
+    uint64_t first_update_id{};
+    uint64_t last_update_id{};
+    std::string_view symbol;     // Points into the input buffer
+    std::string_view bids, asks; // The [[...],...] arrays, pointing into the input buffer
+};
+
+// What happened to a message, with per-message timings so parse and apply costs can be told apart
+struct ParseReport
+{
+    MessageType type = MessageType::Unknown;
+    bool ok = false;
+    bool applied = false; // Parsed and not dropped by the book's update id sequencing
+    uint64_t update_id = 0;
+    std::string_view symbol; // bookTicker and depthUpdate only, points into the input buffer
+    int64_t parse_ns = 0;
+    int64_t apply_ns = 0;
+};
+
+// Forward-only reader over a JSON buffer with just the operations the message shapes need
+class JsonScanner
+{
+public:
+    explicit JsonScanner(std::string_view json) : pos(json.data()), end(json.data() + json.size()) {}
+
+    void skip_ws()
+    {
+        while (pos < end && (*pos == ' ' || *pos == '\n' || *pos == '\r' || *pos == '\t'))
+            ++pos;
+    }
+
+    // Consume c (after any whitespace) if it's next
+    bool consume(char c)
+    {
+        skip_ws();
+        if (pos < end && *pos == c) {
+            ++pos;
+            return true;
+        }
+        return false;
+    }
+
+    bool peek(char c)
+    {
+        skip_ws();
+        return pos < end && *pos == c;
+    }
+
+    // A string without escapes, which is all Binance sends for keys and symbols
+    bool read_string(std::string_view& out)
+    {
+        if (!consume('"'))
+            return false;
+        const char* start = pos;
+        while (pos < end && *pos != '"') {
+            if (*pos == '\\')
+                return false;
+            ++pos;
+        }
+        if (pos == end)
+            return false;
+        out = { start, static_cast<size_t>(pos - start) };
+        ++pos;
+        return true;
+    }
+
+    // "key":
+    bool read_key(std::string_view& key) { return read_string(key) && consume(':'); }
+
+    bool read_uint(uint64_t& out)
+    {
+        skip_ws();
+        const char* start = pos;
+        uint64_t value = 0;
+        while (pos < end && *pos >= '0' && *pos <= '9') {
+            const auto digit = static_cast<uint64_t>(*pos - '0');
+            if (value > (std::numeric_limits<uint64_t>::max() - digit) / 10)
+                return false;
+            value = value * 10 + digit;
+            ++pos;
+        }
+        out = value;
+        return pos != start;
+    }
+
+    /*
+    A decimal, quoted (as Binance sends prices and quantities) or bare. Digits are accumulated into an integer and
+    the number of places after the point is counted, which loses nothing as long as it fits in 18 digits.
+    Fractional digits beyond that are dropped (truncating, Binance never sends more than 8).
+    */
+    bool read_decimal(Decimal& out)
+    {
+        const bool quoted = consume('"');
+        if (!quoted)
+            skip_ws();
+
+        uint64_t digits = 0;
+        int decimals = 0;
+        bool seen_point = false;
+        bool seen_digit = false;
+        bool full = false;
+        for (; pos < end; ++pos) {
+            const char c = *pos;
+            if (c >= '0' && c <= '9') {
+                seen_digit = true;
+                if (full || (seen_point && decimals == max_decimals))
+                    continue;
+                digits = digits * 10 + static_cast<uint64_t>(c - '0');
+                full = digits >= max_digits;
+                if (seen_point)
+                    ++decimals;
+                else if (full)
+                    return false; // Integer part too big to represent
+            }
+            else if (c == '.' && !seen_point) {
+                seen_point = true;
+            }
+            else {
+                break;
+            }
+        }
+
+        if (!seen_digit || (quoted && !consume('"')))
+            return false;
+        out = { digits, decimals };
+        return true;
+    }
+
+    // ["price","qty"]
+    bool read_level(DecimalLevel& out)
+    {
+        return consume('[') && read_decimal(out.price) && consume(',') && read_decimal(out.quantity) && consume(']');
+    }
+
+    // Start of the unread input, to slice out the raw text of a value
+    const char* position() const { return pos; }
+
+    // [["price","qty"],...] checked and kept as its raw text, for DecimalLevels to parse later
+    bool read_raw_levels(std::string_view& raw)
+    {
+        size_t count;
+        skip_ws();
+        const char* start = pos;
+        if (!read_levels({}, count))
+            return false;
+        raw = { start, static_cast<size_t>(pos - start) };
+        return true;
+    }
+
+    // [["price","qty"],...], keeping the first out.size() levels
+    bool read_levels(std::span<DecimalLevel> out, size_t& count)
+    {
+        count = 0;
+        if (!consume('['))
+            return false;
+        if (consume(']'))
+            return true;
+        do {
+            DecimalLevel level;
+            if (!read_level(level))
+                return false;
+            if (count < out.size())
+                out[count++] = level;
+        } while (consume(','));
+        return consume(']');
+    }
+
+    // Skip over any value we don't care about
+    bool skip_value()
+    {
+        skip_ws();
+        if (pos == end)
+            return false;
+        if (*pos == '"') {
+            std::string_view ignored;
+            return read_string(ignored);
+        }
+        if (*pos == '[' || *pos == '{') {
+            int depth = 0;
+            bool in_string = false;
+            for (; pos < end; ++pos) {
+                const char c = *pos;
+                if (in_string) {
+                    if (c == '\\')
+                        ++pos;
+                    else if (c == '"')
+                        in_string = false;
+                }
+                else if (c == '"') {
+                    in_string = true;
+                }
+                else if (c == '[' || c == '{') {
+                    ++depth;
+                }
+                else if ((c == ']' || c == '}') && --depth == 0) {
+                    ++pos;
+                    return true;
+                }
+            }
+            return false;
+        }
+        // Number, true, false or null
+        const char* start = pos;
+        while (pos < end && *pos != ',' && *pos != '}' && *pos != ']' && *pos != ' ')
+            ++pos;
+        return pos != start;
+    }
+
+private:
+    static constexpr int max_decimals = 18;
+    static constexpr uint64_t max_digits = 100'000'000'000'000'000; // 1e17, so one more digit can't overflow
+
+    const char* pos;
+    const char* end;
+};
+
+// Which message this is, from its first key, or from the event type when that comes first
+inline MessageType detect_message_type(std::string_view json)
+{
+    JsonScanner scanner(json);
+    std::string_view key;
+    if (!scanner.consume('{') || !scanner.read_key(key))
+        return MessageType::Unknown;
+    if (key == "lastUpdateId")
+        return MessageType::Depth;
+    if (key == "u")
+        return MessageType::BookTicker;
+    if (key == "e") {
+        std::string_view event;
+        if (!scanner.read_string(event))
+            return MessageType::Unknown;
+        if (event == "depthUpdate")
+            return MessageType::DepthUpdate;
+        if (event == "bookTicker")
+            return MessageType::BookTicker;
+    }
+    return MessageType::Unknown;
+}
+
+/*
+The levels of a depthUpdate array, parsed one at a time as they're iterated. An input range, so it can be handed to
+apply_delta() (through a transform to the book's level type) without collecting the levels anywhere.
+The array must have been validated already (parse_depth_update() does), iteration just stops at anything malformed.
+*/
+class DecimalLevels
+{
+public:
+    class iterator
+    {
+    public:
+        using value_type = DecimalLevel;
+        using difference_type = std::ptrdiff_t;
+
+        iterator() = default;
+        explicit iterator(std::string_view array) : scanner(array)
+        {
+            done = !scanner.consume('[') || scanner.consume(']');
+            read_next(/*first=*/true);
+        }
+
+        const DecimalLevel& operator*() const { return level; }
+        iterator& operator++()
+        {
+            read_next(/*first=*/false);
+            return *this;
+        }
+        void operator++(int) { ++*this; }
+        bool operator==(std::default_sentinel_t) const { return done; }
+
+    private:
+        void read_next(bool first)
+        {
+            if (!done)
+                done = (!first && !scanner.consume(',')) || !scanner.read_level(level);
+        }
+
+        JsonScanner scanner{ std::string_view{} };
+        DecimalLevel level{};
+        bool done = true;
+    };
+
+    explicit DecimalLevels(std::string_view array) : array(array) {}
+
+    iterator begin() const { return iterator(array); }
+    std::default_sentinel_t end() const { return {}; }
+
+private:
+    std::string_view array;
+};
+
+template <size_t n>
+bool parse_depth(std::string_view json, DepthMessage<n>& out)
+{
+    JsonScanner scanner(json);
+    if (!scanner.consume('{'))
+        return false;
+    out.bid_count = out.ask_count = 0;
+    if (scanner.consume('}'))
+        return true;
+    do {
+        std::string_view key;
+        if (!scanner.read_key(key))
+            return false;
+
+        bool ok;
+        if (key == "lastUpdateId")
+            ok = scanner.read_uint(out.update_id);
+        else if (key == "bids")
+            ok = scanner.read_levels(out.bids, out.bid_count);
+        else if (key == "asks")
+            ok = scanner.read_levels(out.asks, out.ask_count);
+        else
+            ok = scanner.skip_value();
+        if (!ok)
+            return false;
+    } while (scanner.consume(','));
+    return scanner.consume('}');
+}
+
+// Same, checking both level arrays are well-formed without keeping any level
+inline bool parse_depth(std::string_view json, RawDepthMessage& out)
+{
+    JsonScanner scanner(json);
+    if (!scanner.consume('{'))
+        return false;
+    out.bids = out.asks = {};
+    if (scanner.consume('}'))
+        return true;
+    do {
+        std::string_view key;
+        if (!scanner.read_key(key))
+            return false;
+
+        bool ok;
+        if (key == "lastUpdateId")
+            ok = scanner.read_uint(out.update_id);
+        else if (key == "bids")
+            ok = scanner.read_raw_levels(out.bids);
+        else if (key == "asks")
+            ok = scanner.read_raw_levels(out.asks);
+        else
+            ok = scanner.skip_value();
+        if (!ok)
+            return false;
+    } while (scanner.consume(','));
+    return scanner.consume('}');
+}
+
+// Checks both level arrays are well-formed, without keeping any level
+inline bool parse_depth_update(std::string_view json, DepthUpdateMessage& out)
+{
+    JsonScanner scanner(json);
+    if (!scanner.consume('{'))
+        return false;
+    if (scanner.consume('}'))
+        return true;
+    do {
+        std::string_view key;
+        if (!scanner.read_key(key))
+            return false;
+
+        bool ok;
+        if (key == "U")
+            ok = scanner.read_uint(out.first_update_id);
+        else if (key == "u")
+            ok = scanner.read_uint(out.last_update_id);
+        else if (key == "s")
+            ok = scanner.read_string(out.symbol);
+        else if (key == "b")
+            ok = scanner.read_raw_levels(out.bids);
+        else if (key == "a")
+            ok = scanner.read_raw_levels(out.asks);
+        else
+            ok = scanner.skip_value();
+        if (!ok)
+            return false;
+    } while (scanner.consume(','));
+    return scanner.consume('}');
+}
+
+inline bool parse_book_ticker(std::string_view json, TickerMessage& out)
+{
+    JsonScanner scanner(json);
+    if (!scanner.consume('{'))
+        return false;
+    if (scanner.consume('}'))
+        return true;
+    do {
+        std::string_view key;
+        if (!scanner.read_key(key))
+            return false;
+
+        bool ok;
+        if (key == "u")
+            ok = scanner.read_uint(out.update_id);
+        else if (key == "s")
+            ok = scanner.read_string(out.symbol);
+        else if (key == "b")
+            ok = scanner.read_decimal(out.bid.price);
+        else if (key == "B")
+            ok = scanner.read_decimal(out.bid.quantity);
+        else if (key == "a")
+            ok = scanner.read_decimal(out.ask.price);
+        else if (key == "A")
+            ok = scanner.read_decimal(out.ask.quantity);
+        else
+            ok = scanner.skip_value();
+        if (!ok)
+            return false;
+    } while (scanner.consume(','));
+    return scanner.consume('}');
+}
+
+// Replace the book with a parsed snapshot. The levels are converted on the fly as replace() reads them.
+// Both apply functions go through the sequenced book API, so they return false for a stale message.
+template <typename Book, size_t m>
+bool apply_depth(const DepthMessage<m>& message, Book& book)
+{
+    const auto& pricing = book.pricing_policy();
+    const auto to_level = [&pricing](const DecimalLevel& level) { return pricing.to_level(level.price, level.quantity); };
+    return book.replace(message.update_id,
+                        std::span(message.bids.data(), message.bid_count) | std::views::transform(to_level),
+                        std::span(message.asks.data(), message.ask_count) | std::views::transform(to_level));
+}
+
+// Same, also recording what the snapshot changed (see BookChangeSet)
+template <typename Book, size_t m>
+bool apply_depth(const DepthMessage<m>& message, Book& book, typename Book::ChangeSet& changes)
+{
+    const auto& pricing = book.pricing_policy();
+    const auto to_level = [&pricing](const DecimalLevel& level) { return pricing.to_level(level.price, level.quantity); };
+    return book.replace(message.update_id,
+                        std::span(message.bids.data(), message.bid_count) | std::views::transform(to_level),
+                        std::span(message.asks.data(), message.ask_count) | std::views::transform(to_level),
+                        changes);
+}
+
+// A raw snapshot's levels are parsed again as replace() reads them, and only as far as the book's depth
+template <typename Book>
+bool apply_depth(const RawDepthMessage& message, Book& book)
+{
+    const auto& pricing = book.pricing_policy();
+    const auto to_level = [&pricing](const DecimalLevel& level) { return pricing.to_level(level.price, level.quantity); };
+    return book.replace(message.update_id,
+                        DecimalLevels(message.bids) | std::views::transform(to_level),
+                        DecimalLevels(message.asks) | std::views::transform(to_level));
+}
+
+template <typename Book>
+bool apply_book_ticker(const TickerMessage& message, Book& book)
+{
+    const auto& pricing = book.pricing_policy();
+    return book.update_bbo(BasicBookTicker<typename Book::Level>{
+        message.update_id,
+        pricing.to_level(message.bid.price, message.bid.quantity),
+        pricing.to_level(message.ask.price, message.ask.quantity) });
+}
+
+// Apply a parsed depthUpdate, parsing its levels again as apply_delta() reads them
+template <typename Book>
+DeltaResult apply_depth_update(const DepthUpdateMessage& message, Book& book)
+{
+    const auto& pricing = book.pricing_policy();
+    const auto to_level = [&pricing](const DecimalLevel& level) { return pricing.to_level(level.price, level.quantity); };
+    return book.apply_delta(message.first_update_id, message.last_update_id,
+                            DecimalLevels(message.bids) | std::views::transform(to_level),
+                            DecimalLevels(message.asks) | std::views::transform(to_level));
+}
+
+// Parse a depth, bookTicker or depthUpdate message and apply it to book, timing both steps
+template <typename Book>
+ParseReport handle_message(std::string_view json, Book& book)
+{
+    ParseReport report;
+    const int64_t start = steady_now_ns();
+    report.type = detect_message_type(json);
+
+    if (report.type == MessageType::Depth) {
+        using Message = std::conditional_t<sizeof(DepthMessage<Book::max_depth>) <= max_stack_depth_message,
+                                           DepthMessage<Book::max_depth>, RawDepthMessage>;
+        Message message;
+        report.ok = parse_depth(json, message);
+        report.update_id = message.update_id;
+        const int64_t parsed = steady_now_ns();
+        report.parse_ns = parsed - start;
+        if (report.ok) {
+            report.applied = apply_depth(message, book);
+            report.apply_ns = steady_now_ns() - parsed;
+        }
+    }
+    else if (report.type == MessageType::BookTicker) {
+        TickerMessage message;
+        report.ok = parse_book_ticker(json, message);
+        report.update_id = message.update_id;
+        report.symbol = message.symbol;
+        const int64_t parsed = steady_now_ns();
+        report.parse_ns = parsed - start;
+        if (report.ok) {
+            report.applied = apply_book_ticker(message, book);
+            report.apply_ns = steady_now_ns() - parsed;
+        }
+    }
+    else if (report.type == MessageType::DepthUpdate) {
+        DepthUpdateMessage message;
+        report.ok = parse_depth_update(json, message);
+        report.update_id = message.last_update_id;
+        report.symbol = message.symbol;
+        const int64_t parsed = steady_now_ns();
+        report.parse_ns = parsed - start;
+        if (report.ok) {
+            report.applied = apply_depth_update(message, book) == DeltaResult::Applied;
+            report.apply_ns = steady_now_ns() - parsed;
+        }
+    }
+    else {
+        report.parse_ns = steady_now_ns() - start;
+    }
+    return report;
+}
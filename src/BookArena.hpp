@@ -0,0 +1,130 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <new>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+/*
+One up-front block of memory that books and their scratch buffers are carved out of, so thousands of books sit in
+one contiguous mapping instead of wherever the allocator put them.
+
+Books already hold their levels inline (see SideStorage.hpp), so where the arena helps is where the books themselves
+go: BookRegistry can place its book slots, and optionally a scratch area per book, in an arena (see BookRegistry.hpp).
+With huge pages a few 2 MB pages cover every book, so walking many books doesn't cost a TLB miss per book.
+
+ - huge_pages: ask for explicit huge pages (MAP_HUGETLB, they have to be reserved in /proc/sys/vm/nr_hugepages).
+   If there aren't any, fall back to normal pages with transparent huge pages requested (MADV_HUGEPAGE).
+   on_huge_pages() says whether the explicit ones were obtained.
+ - prefault: touch every page in the constructor, so the first update to a book doesn't take a page fault.
+
+Allocation is a pointer bump and nothing is ever freed individually, the whole block goes with the arena. It has to
+outlive everything allocated from it. Without mmap (non-POSIX builds) the block comes from operator new.
+*/
+
+struct ArenaOptions
+{
+    bool huge_pages = false;
+    bool prefault = true;
+};
+
+class BookArena
+{
+public:
+    static constexpr size_t page_size = 4096;
+    static constexpr size_t huge_page_size = 2 * 1024 * 1024;
+
+    explicit BookArena(size_t bytes, const ArenaOptions& options = {})
+    {
+        bytes = round_up(bytes == 0 ? 1 : bytes, options.huge_pages ? huge_page_size : page_size);
+#if defined(__unix__) || defined(__APPLE__)
+#ifdef MAP_HUGETLB
+        if (options.huge_pages) {
+            void* mapping = ::mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+            if (mapping != MAP_FAILED) {
+                base = static_cast<std::byte*>(mapping);
+                huge = true;
+            }
+        }
+#endif
+        if (base == nullptr) {
+            void* mapping = ::mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            if (mapping == MAP_FAILED)
+                throw std::bad_alloc();
+            base = static_cast<std::byte*>(mapping);
+#ifdef MADV_HUGEPAGE
+            if (options.huge_pages)
+                ::madvise(mapping, bytes, MADV_HUGEPAGE);
+#endif
+        }
+#else
+        base = static_cast<std::byte*>(::operator new(bytes, std::align_val_t{ page_size }));
+        std::memset(base, 0, bytes);
+#endif
+        size = bytes;
+        if (options.prefault)
+            prefault();
+    }
+
+    BookArena(const BookArena&) = delete;
+    BookArena& operator=(const BookArena&) = delete;
+
+    ~BookArena()
+    {
+#if defined(__unix__) || defined(__APPLE__)
+        ::munmap(base, size);
+#else
+        ::operator delete(base, std::align_val_t{ page_size });
+#endif
+    }
+
+    // bytes aligned to alignment (a power of two), or nullptr if the arena doesn't have them left.
+    // The memory is zeroed (fresh pages) but no object is constructed in it.
+    void* allocate(size_t bytes, size_t alignment)
+    {
+        const size_t start = round_up(used_bytes, alignment);
+        if (start > size || size - start < bytes)
+            return nullptr;
+        used_bytes = start + bytes;
+        return base + start;
+    }
+
+    // Room for count Ts, see above
+    template <typename T>
+    T* allocate_array(size_t count)
+    {
+        return static_cast<T*>(allocate(sizeof(T) * count, alignof(T)));
+    }
+
+    size_t capacity() const { return size; }
+    size_t used() const { return used_bytes; }
+    bool on_huge_pages() const { return huge; }
+
+    // Whether p points into the arena
+    bool owns(const void* p) const
+    {
+        const auto* byte = static_cast<const std::byte*>(p);
+        return byte >= base && byte < base + size;
+    }
+
+private:
+    static size_t round_up(size_t value, size_t alignment) { return (value + alignment - 1) & ~(alignment - 1); }
+
+    // One write per page is enough for the kernel to back it
+    void prefault()
+    {
+        const size_t step = huge ? huge_page_size : page_size;
+        for (size_t offset = 0; offset < size; offset += step)
+            static_cast<volatile std::byte*>(base)[offset] = std::byte{ 0 };
+    }
+
+    std::byte* base = nullptr;
+    size_t size = 0;
+    size_t used_bytes = 0;
+    bool huge = false;
+};
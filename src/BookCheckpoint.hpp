@@ -0,0 +1,336 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <span>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <vector>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#else
+#include <fstream>
+#endif
+
+#include "BinanceBook.hpp"
+#include "BookRegistry.hpp"
+#include "MappedFile.hpp"
+
+/*
+Checkpoint of every book in a registry, so a restarted process has books to serve straight away instead of waiting
+for each symbol's next depth snapshot.
+
+The file is a fixed binary layout, written through a shared mapping:
+ - CheckpointFileHeader: magic, version, depth (levels a side in each record), capacity (records in each copy), and
+   the generation: how many complete passes have been written.
+ - Two copies of capacity records, each a CheckpointRecordHeader (symbol, last update id, snapshot id, level counts)
+   followed by depth bid levels then depth ask levels, PriceQuantity doubles like a capture (see CaptureLog.hpp).
+A pass writes every book into the copy the last complete pass didn't use, and only then bumps the generation, so
+the file always holds one complete checkpoint even if the process dies partway through a pass. A writer opened on
+an existing checkpoint of the same layout carries on from its generation, so that holds from one run to the next
+too. Native endian, so it's for restarting on the same machine.
+
+Writing never stops the update thread for long. step() copies at most max_books books and returns, so the thread
+that owns the books can call it between messages (a few books a call is a few hundred nanoseconds) and a pass
+completes over many calls; each book is copied as of the moment step() reached it. For a registry of SeqlockBooks
+step() reads each book through its seqlock instead, so it can run on a thread of its own while the writers carry on.
+Either way the kernel writes the dirty pages back in the background (msync with MS_ASYNC at the end of each pass),
+the writer never waits for the disk.
+
+On startup CheckpointReader maps the file and restore() applies each record to the registry's book for its symbol
+with the sequenced replace(), so the book is served as it was at the checkpoint and carries its update id: older
+live updates are dropped as stale and newer ones apply, with a diff that doesn't follow on reporting a gap until the
+next snapshot (see apply_delta()), which is how the book reconciles.
+
+Without mmap (non-POSIX builds) the writer keeps the image in memory and writes the file out at the end of each
+pass, and the reader reads it into memory.
+*/
+
+struct CheckpointFileHeader
+{
+    static constexpr char expected_magic[8] = { 'B', 'B', 'C', 'K', 'P', 'T', '\0', '\0' };
+    static constexpr uint32_t current_version = 1;
+
+    char magic[8];
+    uint32_t version;
+    uint32_t depth;
+    uint64_t capacity;
+    uint64_t generation;  // Complete passes. The last one is in copy (generation - 1) % 2.
+    uint64_t counts[2];   // Books in each copy
+    int64_t saved_ns[2];  // Wall clock time each copy's pass finished
+};
+
+struct CheckpointRecordHeader
+{
+    char symbol[24]; // Zero padded
+    uint64_t update_id;
+    uint64_t snapshot_id;
+    uint32_t bid_count;
+    uint32_t ask_count;
+    uint64_t reserved;
+};
+
+static_assert(sizeof(CheckpointFileHeader) == 64 && sizeof(CheckpointRecordHeader) == 56);
+
+inline size_t checkpoint_record_size(size_t depth)
+{
+    return sizeof(CheckpointRecordHeader) + 2 * depth * sizeof(PriceQuantity);
+}
+
+inline size_t checkpoint_file_size(size_t capacity, size_t depth)
+{
+    return sizeof(CheckpointFileHeader) + 2 * capacity * checkpoint_record_size(depth);
+}
+
+// Whether a file of bytes holds everything header says it does. Divides rather than multiplying, so a header
+// from a damaged or foreign file can't overflow its way past the check.
+inline bool checkpoint_fits(const CheckpointFileHeader& header, size_t bytes)
+{
+    if (bytes < sizeof(CheckpointFileHeader) || header.depth > bytes / (2 * sizeof(PriceQuantity)))
+        return false;
+    return header.capacity <= (bytes - sizeof(CheckpointFileHeader)) / 2 / checkpoint_record_size(header.depth);
+}
+
+inline int64_t wall_now_ns()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+class CheckpointWriter
+{
+public:
+    // A file for up to capacity books of up to depth levels a side. An existing checkpoint with the same layout is
+    // kept, generation and all, so it stays readable until the next pass completes; anything else at path (another
+    // layout, a torn or foreign file) is replaced with an empty checkpoint.
+    CheckpointWriter(const std::string& path, size_t capacity, size_t depth)
+        : file_path(path), bytes(checkpoint_file_size(capacity, depth)), depth(depth), capacity(capacity)
+    {
+#if defined(__unix__) || defined(__APPLE__)
+        fd = ::open(path.c_str(), O_RDWR | O_CREAT, 0644);
+        if (fd < 0)
+            return;
+        struct stat st{};
+        const bool resume = ::fstat(fd, &st) == 0 && static_cast<size_t>(st.st_size) == bytes;
+        if (!resume && ::ftruncate(fd, static_cast<off_t>(bytes)) != 0)
+            return;
+        void* mapping = ::mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (mapping == MAP_FAILED)
+            return;
+        data = static_cast<std::byte*>(mapping);
+#else
+        image.resize(bytes);
+        data = image.data();
+        bool resume = false;
+        if (std::FILE* file = std::fopen(path.c_str(), "rb")) {
+            resume = std::fread(image.data(), 1, image.size(), file) == image.size() && std::fgetc(file) == EOF;
+            std::fclose(file);
+        }
+#endif
+        if (resume && matches_layout())
+            return;
+        CheckpointFileHeader header{};
+        std::memcpy(header.magic, CheckpointFileHeader::expected_magic, sizeof(header.magic));
+        header.version = CheckpointFileHeader::current_version;
+        header.depth = static_cast<uint32_t>(depth);
+        header.capacity = capacity;
+        std::memcpy(data, &header, sizeof(header));
+    }
+
+    CheckpointWriter(const CheckpointWriter&) = delete;
+    CheckpointWriter& operator=(const CheckpointWriter&) = delete;
+
+    ~CheckpointWriter()
+    {
+#if defined(__unix__) || defined(__APPLE__)
+        if (data != nullptr)
+            ::munmap(data, bytes);
+        if (fd >= 0)
+            ::close(fd);
+#endif
+    }
+
+    bool ok() const { return data != nullptr; }
+
+    // Complete passes written
+    uint64_t generation() const { return ok() ? header().generation : 0; }
+
+    // Copy the next max_books books of the current pass, finishing the pass if it reaches the last one. Returns the
+    // number of books copied. Books past the file's capacity aren't saved.
+    template <typename Book>
+    size_t step(const BookRegistry<Book>& books, size_t max_books)
+    {
+        if (!ok())
+            return 0;
+        const size_t total = std::min(books.size(), capacity);
+        const size_t copy = header().generation % 2;
+        const size_t end = std::min(total, cursor + std::min(max_books, total));
+        const size_t copied = end - std::min(cursor, end);
+        for (; cursor < end; ++cursor)
+            save_book(copy, cursor, books.symbol(cursor), books.at(cursor));
+        if (cursor >= total)
+            finish_pass(copy, total);
+        return copied;
+    }
+
+    // A whole pass in one call, e.g. on shutdown
+    template <typename Book>
+    void save(const BookRegistry<Book>& books)
+    {
+        cursor = 0;
+        step(books, books.size());
+    }
+
+private:
+    CheckpointFileHeader& header() const { return *reinterpret_cast<CheckpointFileHeader*>(data); }
+
+    // The file already at path is a checkpoint this writer can carry on from
+    bool matches_layout() const
+    {
+        const CheckpointFileHeader& h = header();
+        return std::memcmp(h.magic, CheckpointFileHeader::expected_magic, sizeof(h.magic)) == 0
+            && h.version == CheckpointFileHeader::current_version && h.depth == depth && h.capacity == capacity
+            && h.counts[0] <= capacity && h.counts[1] <= capacity;
+    }
+
+    std::byte* record(size_t copy, size_t i) const
+    {
+        return data + sizeof(CheckpointFileHeader) + (copy * capacity + i) * checkpoint_record_size(depth);
+    }
+
+    template <typename Book>
+    void save_book(size_t copy, size_t i, std::string_view symbol, const Book& book)
+    {
+        std::byte* const out = record(copy, i);
+        auto* levels = reinterpret_cast<PriceQuantity*>(out + sizeof(CheckpointRecordHeader));
+        CheckpointRecordHeader record_header{};
+        std::memcpy(record_header.symbol, symbol.data(), std::min(symbol.size(), sizeof(record_header.symbol) - 1));
+
+        const auto copy_book = [&](const auto& b) {
+            const auto [bid_count, ask_count] = b.extract_into({ levels, depth }, { levels + depth, depth });
+            return std::make_tuple(b.last_update_id(), b.snapshot_update_id(), bid_count, ask_count);
+        };
+        // A SeqlockBook is read through its seqlock, a plain book directly
+        std::tuple<uint64_t, uint64_t, size_t, size_t> saved;
+        if constexpr (requires { book.read(copy_book); })
+            saved = book.read(copy_book);
+        else
+            saved = copy_book(book);
+        record_header.update_id = std::get<0>(saved);
+        record_header.snapshot_id = std::get<1>(saved);
+        record_header.bid_count = static_cast<uint32_t>(std::get<2>(saved));
+        record_header.ask_count = static_cast<uint32_t>(std::get<3>(saved));
+        std::memcpy(out, &record_header, sizeof(record_header));
+    }
+
+    // The copy is complete: publish it, and let the kernel write it back whenever
+    void finish_pass(size_t copy, size_t total)
+    {
+        CheckpointFileHeader& h = header();
+        h.counts[copy] = total;
+        h.saved_ns[copy] = wall_now_ns();
+        std::atomic_thread_fence(std::memory_order_release); // Records before the generation that covers them
+        ++h.generation;
+        cursor = 0;
+#if defined(__unix__) || defined(__APPLE__)
+        ::msync(data, bytes, MS_ASYNC);
+#else
+        if (std::FILE* file = std::fopen(file_path.c_str(), "wb")) {
+            std::fwrite(image.data(), 1, image.size(), file);
+            std::fclose(file);
+        }
+#endif
+    }
+
+    std::string file_path;
+    size_t bytes;
+    size_t depth;
+    size_t capacity;
+    size_t cursor = 0; // Next book of the pass in progress
+    std::byte* data = nullptr;
+#if defined(__unix__) || defined(__APPLE__)
+    int fd = -1;
+#else
+    std::vector<std::byte> image;
+#endif
+};
+
+// One book as it was saved
+struct CheckpointEntry
+{
+    std::string_view symbol;
+    uint64_t update_id = 0;
+    uint64_t snapshot_id = 0;
+    std::span<const PriceQuantity> bids;
+    std::span<const PriceQuantity> asks;
+};
+
+class CheckpointReader
+{
+public:
+    explicit CheckpointReader(const std::string& path) : file(path), data(file.data()), bytes(file.size())
+    {
+        if (bytes < sizeof(CheckpointFileHeader))
+            return;
+        std::memcpy(&header, data, sizeof(header));
+        good = std::memcmp(header.magic, CheckpointFileHeader::expected_magic, sizeof(header.magic)) == 0
+            && header.version == CheckpointFileHeader::current_version && header.generation > 0
+            && checkpoint_fits(header, bytes);
+        copy = (header.generation - 1) % 2;
+        good = good && header.counts[copy] <= header.capacity;
+    }
+
+    CheckpointReader(const CheckpointReader&) = delete;
+    CheckpointReader& operator=(const CheckpointReader&) = delete;
+
+    // False if the file couldn't be read, isn't a checkpoint, or no pass was ever completed
+    bool ok() const { return good; }
+    size_t size() const { return good ? header.counts[copy] : 0; }
+    size_t depth() const { return header.depth; }
+    uint64_t generation() const { return header.generation; }
+    int64_t saved_ns() const { return good ? header.saved_ns[copy] : 0; }
+
+    CheckpointEntry at(size_t i) const
+    {
+        const std::byte* in = data + sizeof(CheckpointFileHeader) + (copy * header.capacity + i) * checkpoint_record_size(header.depth);
+        const auto* record = reinterpret_cast<const CheckpointRecordHeader*>(in);
+        const auto* levels = reinterpret_cast<const PriceQuantity*>(in + sizeof(CheckpointRecordHeader));
+        CheckpointEntry entry;
+        entry.symbol = { record->symbol, strnlen(record->symbol, sizeof(record->symbol)) };
+        entry.update_id = record->update_id;
+        entry.snapshot_id = record->snapshot_id;
+        entry.bids = { levels, std::min<size_t>(record->bid_count, header.depth) };
+        entry.asks = { levels + header.depth, std::min<size_t>(record->ask_count, header.depth) };
+        return entry;
+    }
+
+    // Load every saved book into the registry's book for its symbol (symbols without one are skipped) with the
+    // sequenced replace(). Returns the number of books restored. A book that already has something newer keeps it.
+    template <typename Book>
+    size_t restore(BookRegistry<Book>& books) const
+    {
+        size_t restored = 0;
+        for (size_t i = 0; i < size(); ++i) {
+            const CheckpointEntry entry = at(i);
+            if (Book* book = books.find(entry.symbol))
+                restored += book->replace(entry.update_id, entry.bids, entry.asks);
+        }
+        return restored;
+    }
+
+private:
+    MappedFile file;
+    const std::byte* data;
+    size_t bytes;
+    CheckpointFileHeader header{};
+    size_t copy = 0;
+    bool good = false;
+};
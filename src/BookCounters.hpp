@@ -0,0 +1,224 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <type_traits>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#include <x86intrin.h>
+#endif
+
+/*
+Counters for what update_side() actually does, to tell where update latency goes in production.
+
+Compiled out unless BINANCEBOOK_COUNTERS is 1 (the CMake option of the same name sets it): the book then holds an
+empty NoBookCounters and every call to it disappears. When enabled, each book counts:
+ - quantity_updates: the price was already at the front, only its quantity changed
+ - inserts:          a new front level was pushed
+ - prefix_dropped:   levels ahead of the new top on its own side, removed
+ - trimmed:          worst levels pushed out by an insert at full depth
+ - uncrossed:        levels on the opposite side removed because the new top crosses them
+ - rejected:         updates ignored by the price <= 0 guard
+The book's writer is the only thread that changes them, so each increment is a relaxed load and store rather than
+a locked read-modify-write, and any thread can read them while the writer keeps going.
+
+With BINANCEBOOK_TSC_SAMPLE_PERIOD set to a power of two p, one update_side() call in p is also timed in TSC cycles
+(steady clock nanoseconds off x86) and attributed to what it did: uncross if it removed any opposite levels,
+otherwise insert or quantity.
+*/
+
+#ifndef BINANCEBOOK_COUNTERS
+#define BINANCEBOOK_COUNTERS 0
+#endif
+
+#ifndef BINANCEBOOK_TSC_SAMPLE_PERIOD
+#define BINANCEBOOK_TSC_SAMPLE_PERIOD 0
+#endif
+
+static_assert((BINANCEBOOK_TSC_SAMPLE_PERIOD & (BINANCEBOOK_TSC_SAMPLE_PERIOD - 1)) == 0,
+              "BINANCEBOOK_TSC_SAMPLE_PERIOD must be 0 or a power of two");
+
+inline uint64_t read_cycle_counter()
+{
+#if defined(__x86_64__) || defined(_M_X64)
+    return __rdtsc();
+#else
+    return static_cast<uint64_t>(std::chrono::steady_clock::now().time_since_epoch().count());
+#endif
+}
+
+// Sampled cost of one kind of update
+struct CycleSample
+{
+    uint64_t samples = 0;
+    uint64_t total_cycles = 0;
+    uint64_t max_cycles = 0;
+
+    double mean() const { return samples == 0 ? 0.0 : static_cast<double>(total_cycles) / static_cast<double>(samples); }
+};
+
+// A plain copy of the counters, to export or add up across books
+struct BookCounterValues
+{
+    uint64_t quantity_updates = 0;
+    uint64_t inserts = 0;
+    uint64_t prefix_dropped = 0;
+    uint64_t trimmed = 0;
+    uint64_t uncrossed = 0;
+    uint64_t rejected = 0;
+    CycleSample quantity_cycles, insert_cycles, uncross_cycles;
+
+    BookCounterValues& operator+=(const BookCounterValues& other)
+    {
+        quantity_updates += other.quantity_updates;
+        inserts += other.inserts;
+        prefix_dropped += other.prefix_dropped;
+        trimmed += other.trimmed;
+        uncrossed += other.uncrossed;
+        rejected += other.rejected;
+        const auto add = [](CycleSample& mine, const CycleSample& theirs) {
+            mine.samples += theirs.samples;
+            mine.total_cycles += theirs.total_cycles;
+            mine.max_cycles = std::max(mine.max_cycles, theirs.max_cycles);
+        };
+        add(quantity_cycles, other.quantity_cycles);
+        add(insert_cycles, other.insert_cycles);
+        add(uncross_cycles, other.uncross_cycles);
+        return *this;
+    }
+};
+
+// What one update_side() call did
+struct SideUpdateEvent
+{
+    bool inserted = false;
+    bool trimmed = false;
+    uint32_t prefix_dropped = 0;
+    uint32_t uncrossed = 0;
+};
+
+class BookCounters
+{
+public:
+    static constexpr bool enabled = true;
+    static constexpr uint64_t sample_period = BINANCEBOOK_TSC_SAMPLE_PERIOD;
+
+    BookCounters() = default;
+    BookCounters(const BookCounters& other) { *this = other; }
+    BookCounters& operator=(const BookCounters& other)
+    {
+        const BookCounterValues v = other.values();
+        quantity_updates.store(v.quantity_updates, std::memory_order_relaxed);
+        inserts.store(v.inserts, std::memory_order_relaxed);
+        prefix_dropped.store(v.prefix_dropped, std::memory_order_relaxed);
+        trimmed.store(v.trimmed, std::memory_order_relaxed);
+        uncrossed.store(v.uncrossed, std::memory_order_relaxed);
+        rejected.store(v.rejected, std::memory_order_relaxed);
+        quantity_cycles.set(v.quantity_cycles);
+        insert_cycles.set(v.insert_cycles);
+        uncross_cycles.set(v.uncross_cycles);
+        return *this;
+    }
+
+    // Writer side
+
+    void on_rejected() { bump(rejected, 1); }
+
+    void on_update(const SideUpdateEvent& event)
+    {
+        bump(event.inserted ? inserts : quantity_updates, 1);
+        bump(trimmed, event.trimmed);
+        bump(prefix_dropped, event.prefix_dropped);
+        bump(uncrossed, event.uncrossed);
+    }
+
+    // Whether to time this call, and the cycle counter at its start if so
+    bool start_sample(uint64_t& start)
+    {
+        if constexpr (sample_period == 0) {
+            return false;
+        }
+        else {
+            if ((tick++ & (sample_period - 1)) != 0)
+                return false;
+            start = read_cycle_counter();
+            return true;
+        }
+    }
+
+    void end_sample(uint64_t start, const SideUpdateEvent& event)
+    {
+        const uint64_t cycles = read_cycle_counter() - start;
+        (event.uncrossed != 0 ? uncross_cycles : event.inserted ? insert_cycles : quantity_cycles).add(cycles);
+    }
+
+    // Any thread
+
+    BookCounterValues values() const
+    {
+        BookCounterValues v;
+        v.quantity_updates = quantity_updates.load(std::memory_order_relaxed);
+        v.inserts = inserts.load(std::memory_order_relaxed);
+        v.prefix_dropped = prefix_dropped.load(std::memory_order_relaxed);
+        v.trimmed = trimmed.load(std::memory_order_relaxed);
+        v.uncrossed = uncrossed.load(std::memory_order_relaxed);
+        v.rejected = rejected.load(std::memory_order_relaxed);
+        v.quantity_cycles = quantity_cycles.get();
+        v.insert_cycles = insert_cycles.get();
+        v.uncross_cycles = uncross_cycles.get();
+        return v;
+    }
+
+private:
+    // Single writer, so no locked instruction is needed
+    static void bump(std::atomic<uint64_t>& counter, uint64_t n)
+    {
+        counter.store(counter.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+    }
+
+    struct AtomicCycleSample
+    {
+        std::atomic<uint64_t> samples{ 0 }, total_cycles{ 0 }, max_cycles{ 0 };
+
+        void add(uint64_t cycles)
+        {
+            bump(samples, 1);
+            bump(total_cycles, cycles);
+            if (cycles > max_cycles.load(std::memory_order_relaxed))
+                max_cycles.store(cycles, std::memory_order_relaxed);
+        }
+
+        CycleSample get() const
+        {
+            return { samples.load(std::memory_order_relaxed), total_cycles.load(std::memory_order_relaxed),
+                     max_cycles.load(std::memory_order_relaxed) };
+        }
+
+        void set(const CycleSample& v)
+        {
+            samples.store(v.samples, std::memory_order_relaxed);
+            total_cycles.store(v.total_cycles, std::memory_order_relaxed);
+            max_cycles.store(v.max_cycles, std::memory_order_relaxed);
+        }
+    };
+
+    std::atomic<uint64_t> quantity_updates{ 0 }, inserts{ 0 }, prefix_dropped{ 0 }, trimmed{ 0 }, uncrossed{ 0 }, rejected{ 0 };
+    AtomicCycleSample quantity_cycles, insert_cycles, uncross_cycles;
+    uint64_t tick = 0; // Writer only, picks the calls to sample
+};
+
+// Same interface, does nothing and takes no space in the book
+struct NoBookCounters
+{
+    static constexpr bool enabled = false;
+
+    void on_rejected() {}
+    void on_update(const SideUpdateEvent&) {}
+    bool start_sample(uint64_t&) { return false; }
+    void end_sample(uint64_t, const SideUpdateEvent&) {}
+    BookCounterValues values() const { return {}; }
+};
+
+using BookCountersType = std::conditional_t<BINANCEBOOK_COUNTERS != 0, BookCounters, NoBookCounters>;
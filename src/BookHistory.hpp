@@ -0,0 +1,341 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <span>
+#include <tuple>
+
+#include "BinanceBook.hpp"
+
+/*
+What a book looked like a little while ago, for latency attribution and backtest fills.
+
+The owner calls record() after updating the book, with the update id and a timestamp, and state_at() /
+state_at_time() rebuild the book as of any recorded update that's still in the history.
+
+Most updates change one or two levels, so storing every state in full would mostly store the same levels again.
+States are kept in segments instead: the first state of a segment is a keyframe with every level, and each state
+after it is stored as the levels that changed since the one before (the absolute quantity at a price, or a removal,
+like a diff-depth update). Rebuilding a state is the segment's keyframe plus at most keyframe_interval - 1 deltas.
+
+Memory is fixed when the history is made, nothing allocates after that:
+ - keyframes segments, the oldest segment is overwritten when a new one is needed
+ - keyframe_interval states a segment, the keyframe included
+ - changes_per_keyframe level changes a segment can hold; a state whose delta doesn't fit starts a new segment
+So at least (keyframes - 1) * keyframe_interval states are kept while updates are small, fewer if they change many
+levels, and memory_bytes() says what it all costs.
+
+Levels are the book's decimal PriceQuantity (what its views give), so this works the same for every book type.
+Update ids and timestamps have to increase from one record() to the next, like the book's own sequencing.
+*/
+
+struct HistoryOptions
+{
+    size_t keyframes = 64;
+    size_t keyframe_interval = 32;
+    size_t changes_per_keyframe = 128;
+};
+
+// A rebuilt book, see BookHistory::state_at()
+template <size_t n>
+struct HistoryState
+{
+    uint64_t update_id = 0;
+    int64_t timestamp_ns = 0;
+    std::array<PriceQuantity, n> bid_levels{};
+    std::array<PriceQuantity, n> ask_levels{};
+    size_t bid_count = 0;
+    size_t ask_count = 0;
+
+    std::span<const PriceQuantity> bids() const { return { bid_levels.data(), bid_count }; }
+    std::span<const PriceQuantity> asks() const { return { ask_levels.data(), ask_count }; }
+};
+
+template <typename Book>
+class BookHistory
+{
+public:
+    static constexpr size_t n = Book::max_depth;
+    using State = HistoryState<n>;
+
+    explicit BookHistory(const HistoryOptions& options = {})
+        : segment_count(std::max<size_t>(options.keyframes, 1)),
+          interval(std::max<size_t>(options.keyframe_interval, 1)),
+          change_capacity(options.changes_per_keyframe),
+          segments(std::make_unique<Segment[]>(segment_count)),
+          keyframe_levels(std::make_unique<PriceQuantity[]>(segment_count * 2 * n)),
+          entries(std::make_unique<Entry[]>(segment_count * interval)),
+          changes(std::make_unique<PriceQuantity[]>(segment_count * change_capacity)),
+          last(std::make_unique<State>())
+    {
+    }
+
+    BookHistory(const BookHistory&) = delete;
+    BookHistory& operator=(const BookHistory&) = delete;
+
+    // Record the book's current state as of update_id. False (and nothing recorded) if update_id or timestamp_ns
+    // don't move forward from the last record.
+    bool record(const Book& book, uint64_t update_id, int64_t timestamp_ns)
+    {
+        if (used > 0 && (update_id <= last->update_id || timestamp_ns < last->timestamp_ns))
+            return false;
+
+        Segment* segment = used > 0 ? &segments[newest] : nullptr;
+        if (segment == nullptr || segment->entry_count == interval || !append_delta(*segment, book))
+            segment = &start_segment(book);
+
+        Entry& entry = entries[newest * interval + segment->entry_count++];
+        entry.update_id = update_id;
+        entry.timestamp_ns = timestamp_ns;
+        entry.change_end = segment->change_count;
+        entry.bid_changes = pending_bid_changes;
+
+        copy_book(book, *last);
+        last->update_id = update_id;
+        last->timestamp_ns = timestamp_ns;
+        ++recorded;
+        return true;
+    }
+
+    // The book as of the last recorded update at or before update_id. False if that's older than the history goes.
+    bool state_at(uint64_t update_id, State& out) const
+    {
+        return rebuild([update_id](const Entry& entry) { return entry.update_id <= update_id; }, out);
+    }
+
+    // The book as of the last update recorded at or before timestamp_ns
+    bool state_at_time(int64_t timestamp_ns, State& out) const
+    {
+        return rebuild([timestamp_ns](const Entry& entry) { return entry.timestamp_ns <= timestamp_ns; }, out);
+    }
+
+    // States that can still be rebuilt, and the oldest of them
+    size_t size() const
+    {
+        size_t total = 0;
+        for (size_t i = 0; i < used; ++i)
+            total += segments[i].entry_count;
+        return total;
+    }
+    std::optional<uint64_t> oldest_update_id() const
+    {
+        return used > 0 ? std::optional(entries[oldest() * interval].update_id) : std::nullopt;
+    }
+
+    uint64_t records() const { return recorded; }
+
+    // Everything the history allocated
+    size_t memory_bytes() const
+    {
+        return sizeof(*this) + segment_count * (sizeof(Segment) + 2 * n * sizeof(PriceQuantity))
+            + segment_count * interval * sizeof(Entry) + segment_count * change_capacity * sizeof(PriceQuantity) + sizeof(State);
+    }
+
+    void clear()
+    {
+        used = 0;
+        newest = 0;
+    }
+
+private:
+    // A removal in a delta; real levels never have a negative quantity
+    static constexpr Quantity removed_quantity = -1;
+
+    struct Segment
+    {
+        uint32_t bid_count = 0; // The keyframe's levels
+        uint32_t ask_count = 0;
+        uint32_t entry_count = 0;
+        uint32_t change_count = 0;
+    };
+
+    // One recorded state. Its delta is the segment's changes from the previous entry's change_end up to its own,
+    // bids first. The segment's first entry is the keyframe and has none.
+    struct Entry
+    {
+        uint64_t update_id = 0;
+        int64_t timestamp_ns = 0;
+        uint32_t change_end = 0;
+        uint32_t bid_changes = 0;
+    };
+
+    size_t oldest() const { return used < segment_count ? 0 : (newest + 1) % segment_count; }
+
+    // The i-th segment from the oldest
+    size_t segment_at(size_t i) const { return (oldest() + i) % segment_count; }
+
+    Segment& start_segment(const Book& book)
+    {
+        newest = used == 0 ? 0 : (newest + 1) % segment_count;
+        used = std::min(used + 1, segment_count);
+
+        Segment& segment = segments[newest];
+        PriceQuantity* levels = &keyframe_levels[newest * 2 * n];
+        const auto [bid_count, ask_count] = book.extract_into({ levels, n }, { levels + n, n });
+        segment = { static_cast<uint32_t>(bid_count), static_cast<uint32_t>(ask_count), 0, 0 };
+        pending_bid_changes = 0;
+        return segment;
+    }
+
+    // Diff the book against the last recorded state into the segment's changes. False if they don't fit, in which
+    // case the segment is left as it was.
+    bool append_delta(Segment& segment, const Book& book)
+    {
+        const size_t start = segment.change_count;
+        size_t count = start;
+        PriceQuantity* pool = &changes[newest * change_capacity];
+        const auto emit = [&](const PriceQuantity& change) {
+            if (count == change_capacity)
+                return false;
+            pool[count++] = change;
+            return true;
+        };
+        if (!diff(last->bids(), book.bid_view(), /*is_bid=*/true, emit))
+            return false;
+        const size_t bid_changes = count - start;
+        if (!diff(last->asks(), book.ask_view(), /*is_bid=*/false, emit))
+            return false;
+        segment.change_count = static_cast<uint32_t>(count);
+        pending_bid_changes = static_cast<uint32_t>(bid_changes);
+        return true;
+    }
+
+    // Merge walk over the old and new side, emitting the new quantity of every level that changed, in price order
+    template <typename Emit>
+    static bool diff(std::span<const PriceQuantity> before, const typename Book::View& after, bool is_bid, Emit&& emit)
+    {
+        size_t i = 0, j = 0;
+        while (i < before.size() || j < after.size()) {
+            if (j == after.size()) {
+                if (!emit(PriceQuantity{ before[i++].price, removed_quantity }))
+                    return false;
+                continue;
+            }
+            const PriceQuantity now = after[j];
+            if (i == before.size()) {
+                if (!emit(now))
+                    return false;
+                ++j;
+                continue;
+            }
+            const PriceQuantity& was = before[i];
+            if (was.price == now.price) {
+                if (was.quantity != now.quantity && !emit(now))
+                    return false;
+                ++i;
+                ++j;
+            }
+            else if (is_bid ? was.price > now.price : was.price < now.price) {
+                if (!emit(PriceQuantity{ was.price, removed_quantity }))
+                    return false;
+                ++i;
+            }
+            else {
+                if (!emit(now))
+                    return false;
+                ++j;
+            }
+        }
+        return true;
+    }
+
+    static void copy_book(const Book& book, State& state)
+    {
+        std::tie(state.bid_count, state.ask_count) = book.extract_into(state.bid_levels, state.ask_levels);
+    }
+
+    // Find the newest entry matching at_or_before (a prefix of the entries, oldest first), then rebuild it from its
+    // segment's keyframe
+    template <typename AtOrBefore>
+    bool rebuild(AtOrBefore&& at_or_before, State& out) const
+    {
+        if (used == 0 || !at_or_before(entries[oldest() * interval]))
+            return false;
+
+        // Last segment whose keyframe qualifies
+        size_t first = 1, len = used - 1;
+        while (len > 0) {
+            const size_t half = len / 2;
+            if (at_or_before(entries[segment_at(first + half) * interval])) {
+                first += half + 1;
+                len -= half + 1;
+            }
+            else {
+                len = half;
+            }
+        }
+        const size_t s = segment_at(first - 1);
+        const Segment& segment = segments[s];
+        const Entry* segment_entries = &entries[s * interval];
+        const size_t last_entry = static_cast<size_t>(
+            std::partition_point(segment_entries, segment_entries + segment.entry_count, at_or_before) - segment_entries - 1);
+
+        const PriceQuantity* levels = &keyframe_levels[s * 2 * n];
+        std::copy(levels, levels + segment.bid_count, out.bid_levels.begin());
+        std::copy(levels + n, levels + n + segment.ask_count, out.ask_levels.begin());
+        out.bid_count = segment.bid_count;
+        out.ask_count = segment.ask_count;
+
+        const PriceQuantity* pool = &changes[s * change_capacity];
+        for (size_t e = 1; e <= last_entry; ++e) {
+            const Entry& entry = segment_entries[e];
+            const size_t begin = segment_entries[e - 1].change_end;
+            // Removals first, so a full side has room for the levels that replaced them
+            for (const bool removals : { true, false }) {
+                for (size_t c = begin; c < entry.change_end; ++c) {
+                    if ((pool[c].quantity == removed_quantity) != removals)
+                        continue;
+                    if (c < begin + entry.bid_changes)
+                        apply(out.bid_levels, out.bid_count, pool[c], /*is_bid=*/true);
+                    else
+                        apply(out.ask_levels, out.ask_count, pool[c], /*is_bid=*/false);
+                }
+            }
+        }
+        out.update_id = segment_entries[last_entry].update_id;
+        out.timestamp_ns = segment_entries[last_entry].timestamp_ns;
+        return true;
+    }
+
+    // Set, insert or remove one level of a rebuilt side
+    static void apply(std::array<PriceQuantity, n>& levels, size_t& count, const PriceQuantity& change, bool is_bid)
+    {
+        const auto end = levels.begin() + count;
+        const auto it = std::partition_point(levels.begin(), end, [&](const PriceQuantity& level) {
+            return is_bid ? level.price > change.price : level.price < change.price;
+        });
+        const bool exists = it != end && it->price == change.price;
+        if (change.quantity == removed_quantity) {
+            if (exists) {
+                std::copy(it + 1, end, it);
+                --count;
+            }
+        }
+        else if (exists) {
+            it->quantity = change.quantity;
+        }
+        else if (count < n) {
+            std::copy_backward(it, end, end + 1);
+            *it = change;
+            ++count;
+        }
+    }
+
+    size_t segment_count;
+    size_t interval;
+    size_t change_capacity;
+    std::unique_ptr<Segment[]> segments;
+    std::unique_ptr<PriceQuantity[]> keyframe_levels; // 2n a segment, bids then asks
+    std::unique_ptr<Entry[]> entries;                 // interval a segment
+    std::unique_ptr<PriceQuantity[]> changes;         // change_capacity a segment
+    std::unique_ptr<State> last;                      // What the last record() saw, to diff the next one against
+
+    size_t used = 0;   // Segments holding states
+    size_t newest = 0; // The one being appended to
+    uint32_t pending_bid_changes = 0;
+    uint64_t recorded = 0;
+};
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <cstddef>
+#include <optional>
+
+/*
+Listener policies, so the book can tell its owner what an update did in the same call instead of being polled.
+
+BinanceBook takes the listener as a template parameter (after Pricing) and calls it directly, no virtual calls.
+A listener derives from BookListener<itself> and declares only the callbacks it wants; the rest fall back to the
+base's empty ones. Levels are in the book's own representation (Level), so fixed-point books report ticks.
+ - on_bbo_change:    once per replace()/update_bbo()/apply_delta() that changed the best bid or ask (price, quantity, or
+                     a side becoming empty or not), with the new top. A batch reports each ticker it applies.
+ - on_level_removed: each level that leaves the book: dropped ahead of a new top, pushed out past depth n, uncrossed,
+                     deleted by a diff, or missing from a new snapshot. It's called before the level is removed,
+                     except for replace(): a snapshot is loaded whole and then compared with the levels it replaced,
+                     so those removals (and its on_level_changed calls) come after the new levels are in, with the
+                     removed level as it was.
+ - on_level_changed: each level that's inserted or gets a new quantity, as it is once it's in. Together with
+                     on_level_removed that's every change to the book's levels, so a listener can keep its own copy
+                     of them in step (see ConsolidatedBook.hpp).
+ - on_uncross:       a new level on one side crossed the other side, and removed `removed` levels there (each of
+                     them also goes through on_level_removed).
+Callbacks run inside the update, with the book partway through it, so they shouldn't call back into the book.
+
+The default NullListener isn't enabled, and the book skips everything it would do to feed a listener (including
+remembering the old top) with if constexpr, so it costs nothing. Same idea as BookCounters.hpp.
+*/
+
+template <typename Derived>
+struct BookListener
+{
+    static constexpr bool enabled = true;
+
+    template <typename Level>
+    void on_bbo_change(const std::optional<Level>& /*best_bid*/, const std::optional<Level>& /*best_ask*/) {}
+
+    template <typename Level>
+    void on_level_removed(bool /*is_bid*/, const Level& /*level*/) {}
+
+    template <typename Level>
+    void on_level_changed(bool /*is_bid*/, const Level& /*level*/) {}
+
+    template <typename Level>
+    void on_uncross(bool /*is_bid*/, const Level& /*crossing*/, size_t /*removed*/) {}
+
+    Derived& derived() { return static_cast<Derived&>(*this); }
+    const Derived& derived() const { return static_cast<const Derived&>(*this); }
+};
+
+struct NullListener : BookListener<NullListener>
+{
+    static constexpr bool enabled = false;
+};
@@ -0,0 +1,213 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <new>
+#include <string_view>
+#include <utility>
+
+#include "BinanceParser.hpp"
+#include "BookArena.hpp"
+#include "SymbolIndex.hpp"
+
+/*
+Owns the books for many symbols and routes parsed messages to them by symbol.
+
+Everything is sized up front from the capacity given to the constructor: books are constructed in place in one
+contiguous array of cache-line aligned slots (books can't be moved, so they never live anywhere else), and symbols
+are resolved with a fixed SymbolIndex. After the symbols have been added nothing here allocates again.
+
+Given a BookArena (see BookArena.hpp) the slots come from it instead, so the books can be on huge pages, prefaulted.
+A scratch area per book can be asked for too, for the work around a book that would otherwise allocate or need a
+buffer of its own: the change set of a replace() and the text of format_to(). It's a separate array after the slots,
+so the books stay packed together. If the arena is too small the registry falls back to the heap, see in_arena().
+*/
+
+// Per-book buffers, see scratch()
+template <typename Book>
+struct BookScratch
+{
+    typename Book::ChangeSet changes;
+    std::array<char, Book::max_format_length> text;
+};
+
+template <typename Book>
+class BookRegistry
+{
+public:
+    static constexpr size_t max_symbol_length = SymbolIndex::max_symbol_length;
+
+    using Scratch = BookScratch<Book>;
+
+    explicit BookRegistry(size_t capacity)
+        : index(capacity),
+          names(std::make_unique<SymbolName[]>(std::max<size_t>(capacity, 1))),
+          slots(static_cast<Slot*>(::operator new(sizeof(Slot) * std::max<size_t>(capacity, 1), std::align_val_t{ alignof(Slot) })))
+    {
+    }
+
+    // Slots (and scratch areas, if with_scratch) from arena, which has to outlive the registry
+    BookRegistry(size_t capacity, BookArena& arena, bool with_scratch = false)
+        : index(capacity), names(std::make_unique<SymbolName[]>(std::max<size_t>(capacity, 1)))
+    {
+        const size_t slot_count = std::max<size_t>(capacity, 1);
+        slots = arena.allocate_array<Slot>(slot_count);
+        if (with_scratch && slots != nullptr)
+            scratch_areas = arena.allocate_array<Scratch>(slot_count);
+        heap_slots = slots == nullptr || (with_scratch && scratch_areas == nullptr);
+        if (heap_slots) {
+            // Doesn't fit, so all of it goes on the heap as if there were no arena
+            slots = static_cast<Slot*>(::operator new(sizeof(Slot) * slot_count, std::align_val_t{ alignof(Slot) }));
+            if (with_scratch)
+                scratch_areas = static_cast<Scratch*>(::operator new(sizeof(Scratch) * slot_count));
+            heap_scratch = with_scratch;
+        }
+        // Only arrays inside, nothing to destroy later
+        for (size_t i = 0; i < slot_count && with_scratch; ++i)
+            new (&scratch_areas[i]) Scratch{};
+    }
+
+    BookRegistry(const BookRegistry&) = delete;
+    BookRegistry& operator=(const BookRegistry&) = delete;
+
+    ~BookRegistry()
+    {
+        for (size_t i = 0; i < count; ++i)
+            slots[i].book.~Book();
+        if (heap_slots)
+            ::operator delete(slots, std::align_val_t{ alignof(Slot) });
+        if (heap_scratch)
+            ::operator delete(scratch_areas);
+    }
+
+    // Create the book for symbol, passing args to its constructor (e.g. the symbol's FixedPointPricing).
+    // Returns the existing book if the symbol is already registered, and nullptr if the registry is full or the
+    // symbol is too long.
+    template <typename... Args>
+    Book* add(std::string_view symbol, Args&&... args)
+    {
+        if (Book* existing = find(symbol))
+            return existing;
+        if (!index.insert(symbol, static_cast<uint32_t>(count)))
+            return nullptr;
+
+        new (&slots[count].book) Book(std::forward<Args>(args)...);
+        std::memcpy(names[count].data(), symbol.data(), symbol.size());
+        return &slots[count++].book;
+    }
+
+    Book* find(std::string_view symbol)
+    {
+        const uint32_t i = index.find(symbol);
+        return i != SymbolIndex::npos ? &slots[i].book : nullptr;
+    }
+
+    // Index of symbol's book for at(), or SymbolIndex::npos
+    uint32_t index_of(std::string_view symbol) const { return index.find(symbol); }
+
+    // Books are numbered in the order they were added
+    size_t size() const { return count; }
+    std::string_view symbol(size_t i) const { return { names[i].data(), strnlen(names[i].data(), names[i].size()) }; }
+    size_t capacity() const { return index.capacity(); }
+    Book& at(size_t i) { return slots[i].book; }
+    const Book& at(size_t i) const { return slots[i].book; }
+
+    // Book i's scratch area, only if the registry was made with_scratch
+    Scratch& scratch(size_t i) { return scratch_areas[i]; }
+    bool has_scratch() const { return scratch_areas != nullptr; }
+
+    // Whether the books ended up in the arena they were given
+    bool in_arena() const { return !heap_slots; }
+
+    // Messages for symbols that have no book
+    uint64_t unknown_symbols() const { return unknown_symbol_count; }
+
+    // Parse a bookTicker and apply it to the book for its "s" field
+    ParseReport on_book_ticker(std::string_view json)
+    {
+        ParseReport report;
+        report.type = MessageType::BookTicker;
+        const int64_t start = steady_now_ns();
+        TickerMessage message;
+        report.ok = parse_book_ticker(json, message);
+        report.update_id = message.update_id;
+        report.symbol = message.symbol;
+
+        Book* book = report.ok ? find(message.symbol) : nullptr;
+        const int64_t parsed = steady_now_ns();
+        report.parse_ns = parsed - start;
+        if (book == nullptr) {
+            unknown_symbol_count += report.ok;
+            report.ok = false;
+            return report;
+        }
+
+        report.applied = apply_book_ticker(message, *book);
+        report.apply_ns = steady_now_ns() - parsed;
+        return report;
+    }
+
+    // Parse a depthUpdate and apply it to the book for its "s" field. report.applied is false for a stale update and
+    // for a gap, in which case the book needs a new snapshot (its sequence_stats().gaps goes up).
+    ParseReport on_depth_update(std::string_view json)
+    {
+        ParseReport report;
+        report.type = MessageType::DepthUpdate;
+        const int64_t start = steady_now_ns();
+        DepthUpdateMessage message;
+        report.ok = parse_depth_update(json, message);
+        report.update_id = message.last_update_id;
+        report.symbol = message.symbol;
+
+        Book* book = report.ok ? find(message.symbol) : nullptr;
+        const int64_t parsed = steady_now_ns();
+        report.parse_ns = parsed - start;
+        if (book == nullptr) {
+            unknown_symbol_count += report.ok;
+            report.ok = false;
+            return report;
+        }
+
+        report.applied = apply_depth_update(message, *book) == DeltaResult::Applied;
+        report.apply_ns = steady_now_ns() - parsed;
+        return report;
+    }
+
+    // Depth payloads don't name their symbol (it's in the stream name), so the caller passes it
+    ParseReport on_depth(std::string_view symbol, std::string_view json)
+    {
+        Book* book = find(symbol);
+        if (book == nullptr) {
+            ++unknown_symbol_count;
+            ParseReport report;
+            report.type = MessageType::Depth;
+            report.symbol = symbol;
+            return report;
+        }
+        ParseReport report = handle_message(json, *book);
+        report.symbol = symbol;
+        return report;
+    }
+
+private:
+    struct alignas(64) Slot
+    {
+        Book book;
+    };
+
+    // Only to go from a book back to its symbol, so kept apart from the slots
+    using SymbolName = std::array<char, max_symbol_length + 1>;
+
+    SymbolIndex index;
+    std::unique_ptr<SymbolName[]> names;
+    Slot* slots = nullptr;
+    Scratch* scratch_areas = nullptr;
+    bool heap_slots = true;
+    bool heap_scratch = false;
+    size_t count = 0;
+    uint64_t unknown_symbol_count = 0;
+};
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <concepts>
+#include <cstddef>
+
+/*
+Compile-time policies a book is put together from.
+
+A book is BasicBinanceBook<Traits>, where Traits names its depth, level storage, pricing, listener and uncross policy
+(BookTraits in BinanceBook.hpp is the usual way to spell one, and BinanceBook<n, ...> is shorthand for that). Anything
+with the same members works as Traits, see the BookTraitsType concept below.
+
+Side policies: the book's update paths are written once as templates over BidSide/AskSide instead of taking an
+is_bid flag, so each side gets its own copy with the comparisons fixed. "Better" is higher for bids and lower for
+asks, and Other is the opposite side, whose levels a new level can cross.
+
+Uncross policies: what happens to the other side's levels when a new level crosses them.
+ - DropCrossed: they're removed there and then, the book is never crossed. This is what the book has always done.
+ - KeepCrossed: they stay until the feed confirms they're gone, by deleting them in a diff, by the other side's own
+   new top in a ticker (which drops the levels ahead of it anyway), or by the next snapshot. Meant for feeds that
+   are known to send those deletes, where a crossing level arriving first is a transient rather than the truth, and
+   dropping would lose levels that are still there. The book can then be crossed in between.
+*/
+
+struct BidSide;
+struct AskSide;
+
+struct BidSide
+{
+    static constexpr bool is_bid = true;
+    using Other = AskSide;
+
+    // a is a better price than b on this side
+    template <typename Price>
+    static constexpr bool better(const Price& a, const Price& b) { return a > b; }
+};
+
+struct AskSide
+{
+    static constexpr bool is_bid = false;
+    using Other = BidSide;
+
+    template <typename Price>
+    static constexpr bool better(const Price& a, const Price& b) { return a < b; }
+};
+
+struct DropCrossed
+{
+    static constexpr bool drop_crossed = true;
+};
+
+struct KeepCrossed
+{
+    static constexpr bool drop_crossed = false;
+};
+
+// What BasicBinanceBook needs from its Traits
+template <typename Traits>
+concept BookTraitsType = requires {
+    { Traits::depth } -> std::convertible_to<size_t>;
+    typename Traits::Level;
+    typename Traits::Price;
+    typename Traits::SideStorage;
+    typename Traits::PricingPolicy;
+    typename Traits::ListenerPolicy;
+    { Traits::UncrossPolicy::drop_crossed } -> std::convertible_to<bool>;
+};
@@ -0,0 +1,266 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "BinanceBook.hpp"
+#include "BinanceParser.hpp"
+#include "MappedFile.hpp"
+
+/*
+Binary capture of the two message types, for replaying recorded market data without parsing anything.
+
+A capture is a file header followed by fixed-size records, nothing else:
+ - CaptureFileHeader: magic, version, and the number of levels a side that depth records hold.
+ - Ticker records: a CaptureRecordHeader and the bid and ask levels (80 bytes).
+ - Depth records: a CaptureRecordHeader and depth() bid levels then depth() ask levels. Unused levels are zeroed.
+Every record starts with its type, and each type has one size, so the reader walks the file by fixed strides.
+Levels are PriceQuantity doubles, the same values the parser produces for a floating-point book, so replaying into
+a book is a straight replace()/update_bbo() on a span of the mapped file.
+The symbol is stored inline, zero padded to 24 bytes like in SymbolIndex. All fields are native endian, so a
+capture can only be replayed on a machine with the same endianness as the one that recorded it.
+*/
+
+enum class CaptureRecordType : uint8_t
+{
+    Depth = 1,
+    BookTicker = 2,
+};
+
+struct CaptureFileHeader
+{
+    static constexpr char expected_magic[8] = { 'B', 'B', 'C', 'A', 'P', 'T', 'U', 'R' };
+    static constexpr uint32_t current_version = 1;
+
+    char magic[8]{};
+    uint32_t version = 0;
+    uint32_t depth = 0; // Levels a side in each depth record
+};
+
+struct CaptureRecordHeader
+{
+    CaptureRecordType type{};
+    uint8_t reserved = 0;
+    uint16_t bid_count = 0;
+    uint16_t ask_count = 0;
+    uint16_t reserved2 = 0;
+    int64_t timestamp_ns = 0; // When it was received, any clock as long as the whole capture uses the same one
+    uint64_t update_id = 0;
+    char symbol[24]{};
+};
+
+static_assert(sizeof(CaptureFileHeader) == 16 && sizeof(CaptureRecordHeader) == 48 && sizeof(PriceQuantity) == 16);
+
+// One record as read back, pointing into the mapped file
+struct CaptureEvent
+{
+    CaptureRecordType type{};
+    int64_t timestamp_ns = 0;
+    uint64_t update_id = 0;
+    std::string_view symbol;
+    std::span<const PriceQuantity> bids, asks; // A ticker has exactly one of each
+};
+
+inline size_t capture_record_size(CaptureRecordType type, size_t depth)
+{
+    return sizeof(CaptureRecordHeader) + sizeof(PriceQuantity) * (type == CaptureRecordType::Depth ? 2 * depth : 2);
+}
+
+/*
+Appends records to a capture file through stdio's buffer, so recording costs a memcpy per message and a write
+syscall every few KB. Levels beyond depth() are dropped, and messages for symbols longer than 23 characters aren't
+recorded (the write returns false, but the writer stays usable).
+*/
+class CaptureWriter
+{
+public:
+    CaptureWriter(const std::string& path, size_t depth) : levels(depth), buffer(capture_record_size(CaptureRecordType::Depth, depth))
+    {
+        file = std::fopen(path.c_str(), "wb");
+        CaptureFileHeader header;
+        std::memcpy(header.magic, CaptureFileHeader::expected_magic, sizeof(header.magic));
+        header.version = CaptureFileHeader::current_version;
+        header.depth = static_cast<uint32_t>(depth);
+        good = file != nullptr && std::fwrite(&header, sizeof(header), 1, file) == 1;
+    }
+
+    CaptureWriter(const CaptureWriter&) = delete;
+    CaptureWriter& operator=(const CaptureWriter&) = delete;
+
+    ~CaptureWriter() { close(); }
+
+    // False once anything failed to open or write
+    bool ok() const { return good; }
+    size_t depth() const { return levels; }
+    uint64_t records() const { return count; }
+
+    bool write_depth(std::string_view symbol, int64_t timestamp_ns, uint64_t update_id,
+                     std::span<const PriceQuantity> bids, std::span<const PriceQuantity> asks)
+    {
+        return append_depth(symbol, timestamp_ns, update_id, bids.size(), asks.size(), [&](std::byte* bid_out, std::byte* ask_out, size_t bid_count, size_t ask_count) {
+            std::memcpy(bid_out, bids.data(), bid_count * sizeof(PriceQuantity));
+            std::memcpy(ask_out, asks.data(), ask_count * sizeof(PriceQuantity));
+        });
+    }
+
+    bool write_book_ticker(std::string_view symbol, int64_t timestamp_ns, const BookTicker& ticker)
+    {
+        if (symbol.size() >= sizeof(CaptureRecordHeader::symbol))
+            return false;
+        struct
+        {
+            CaptureRecordHeader header;
+            PriceQuantity bid, ask;
+        } record{ make_header(CaptureRecordType::BookTicker, symbol, timestamp_ns, ticker.update_id), ticker.bid, ticker.ask };
+        record.header.bid_count = record.header.ask_count = 1;
+        return append(&record, sizeof(record));
+    }
+
+    // Straight from the parser's messages, as a feed handler would record them. The levels are converted into the
+    // record buffer, so a deep message doesn't need a copy of its own.
+    template <size_t m>
+    bool write_depth(std::string_view symbol, int64_t timestamp_ns, const DepthMessage<m>& message)
+    {
+        const auto convert = [](std::byte* out, const DecimalLevel* levels, size_t count) {
+            const FloatingPointPricing pricing;
+            for (size_t i = 0; i < count; ++i) {
+                const PriceQuantity level = pricing.to_level(levels[i].price, levels[i].quantity);
+                std::memcpy(out + i * sizeof(PriceQuantity), &level, sizeof(level));
+            }
+        };
+        return append_depth(symbol, timestamp_ns, message.update_id, message.bid_count, message.ask_count,
+                            [&](std::byte* bid_out, std::byte* ask_out, size_t bid_count, size_t ask_count) {
+                                convert(bid_out, message.bids.data(), bid_count);
+                                convert(ask_out, message.asks.data(), ask_count);
+                            });
+    }
+
+    bool write_book_ticker(int64_t timestamp_ns, const TickerMessage& message)
+    {
+        const FloatingPointPricing pricing;
+        return write_book_ticker(message.symbol, timestamp_ns,
+                                 BookTicker{ message.update_id, pricing.to_level(message.bid.price, message.bid.quantity),
+                                             pricing.to_level(message.ask.price, message.ask.quantity) });
+    }
+
+    bool flush() { return good = good && std::fflush(file) == 0; }
+
+    void close()
+    {
+        if (file != nullptr) {
+            good = std::fclose(file) == 0 && good;
+            file = nullptr;
+        }
+    }
+
+private:
+    static CaptureRecordHeader make_header(CaptureRecordType type, std::string_view symbol, int64_t timestamp_ns, uint64_t update_id)
+    {
+        CaptureRecordHeader header;
+        header.type = type;
+        header.timestamp_ns = timestamp_ns;
+        header.update_id = update_id;
+        std::memcpy(header.symbol, symbol.data(), symbol.size());
+        return header;
+    }
+
+    // Build a depth record in the buffer, with put(bid_out, ask_out, bid_count, ask_count) writing the levels that
+    // fit, and append it
+    template <typename Put>
+    bool append_depth(std::string_view symbol, int64_t timestamp_ns, uint64_t update_id, size_t bid_count, size_t ask_count, Put&& put)
+    {
+        if (symbol.size() >= sizeof(CaptureRecordHeader::symbol))
+            return false;
+        std::fill(buffer.begin(), buffer.end(), std::byte{ 0 });
+        CaptureRecordHeader header = make_header(CaptureRecordType::Depth, symbol, timestamp_ns, update_id);
+        header.bid_count = static_cast<uint16_t>(std::min(bid_count, levels));
+        header.ask_count = static_cast<uint16_t>(std::min(ask_count, levels));
+        std::memcpy(buffer.data(), &header, sizeof(header));
+        std::byte* const bid_out = buffer.data() + sizeof(header);
+        put(bid_out, bid_out + levels * sizeof(PriceQuantity), header.bid_count, header.ask_count);
+        return append(buffer.data(), capture_record_size(CaptureRecordType::Depth, levels));
+    }
+
+    bool append(const void* data, size_t size)
+    {
+        good = good && std::fwrite(data, size, 1, file) == 1;
+        count += good;
+        return good;
+    }
+
+    std::FILE* file = nullptr;
+    size_t levels;
+    std::vector<std::byte> buffer; // One depth record
+    uint64_t count = 0;
+    bool good = false;
+};
+
+/*
+Maps a whole capture read-only and walks it record by record. Nothing is copied: events point into the mapping,
+which the kernel is told will be read sequentially so it reads ahead.
+Without mmap (non-POSIX builds) the file is read into memory instead (see MappedFile.hpp).
+*/
+class CaptureReader
+{
+public:
+    explicit CaptureReader(const std::string& path) : file(path, /*sequential=*/true), data(file.data()), size(file.size())
+    {
+        CaptureFileHeader header;
+        if (size < sizeof(header))
+            return;
+        std::memcpy(&header, data, sizeof(header));
+        good = std::memcmp(header.magic, CaptureFileHeader::expected_magic, sizeof(header.magic)) == 0
+            && header.version == CaptureFileHeader::current_version;
+        levels = header.depth;
+        pos = sizeof(header);
+    }
+
+    CaptureReader(const CaptureReader&) = delete;
+    CaptureReader& operator=(const CaptureReader&) = delete;
+
+    // False if the file couldn't be opened or isn't a capture
+    bool ok() const { return good; }
+    size_t depth() const { return levels; }
+    size_t bytes() const { return size; }
+
+    // The next record, or false at the end of the capture (or at a truncated last record)
+    bool next(CaptureEvent& event)
+    {
+        if (!good || size - pos < sizeof(CaptureRecordHeader))
+            return false;
+        const auto* header = reinterpret_cast<const CaptureRecordHeader*>(data + pos);
+        if (header->type != CaptureRecordType::Depth && header->type != CaptureRecordType::BookTicker)
+            return false;
+        const size_t record_size = capture_record_size(header->type, levels);
+        if (size - pos < record_size)
+            return false;
+
+        const auto* first_level = reinterpret_cast<const PriceQuantity*>(data + pos + sizeof(CaptureRecordHeader));
+        const size_t asks_offset = header->type == CaptureRecordType::Depth ? levels : 1; // Also the most levels a side holds
+        event.type = header->type;
+        event.timestamp_ns = header->timestamp_ns;
+        event.update_id = header->update_id;
+        event.symbol = { header->symbol, strnlen(header->symbol, sizeof(header->symbol)) };
+        event.bids = { first_level, std::min<size_t>(header->bid_count, asks_offset) };
+        event.asks = { first_level + asks_offset, std::min<size_t>(header->ask_count, asks_offset) };
+        pos += record_size;
+        return true;
+    }
+
+    // Back to the first record
+    void rewind() { pos = sizeof(CaptureFileHeader); }
+
+private:
+    MappedFile file;
+    const std::byte* data;
+    size_t size;
+    size_t pos = 0;
+    size_t levels = 0;
+    bool good = false;
+};
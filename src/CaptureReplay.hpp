@@ -0,0 +1,86 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <thread>
+
+#include "BookRegistry.hpp"
+#include "CaptureLog.hpp"
+#include "LatencyHistogram.hpp"
+#include "SpscQueue.hpp"
+#include "util.hpp"
+
+/*
+Replays a capture (see CaptureLog.hpp) into the books of a registry.
+
+Events are applied straight from the mapped file through the sequenced replace()/update_bbo(), so the only per-event
+work besides the book update itself is the symbol lookup. Either flat out, to measure throughput, or paced by the
+recorded timestamps (optionally sped up) to reproduce the production arrival pattern, bursts included.
+*/
+
+struct ReplayOptions
+{
+    bool recorded_timing = false; // Apply each event no earlier than its capture timestamp says, relative to the first
+    double speed = 1.0;           // With recorded_timing, 2 replays twice as fast
+    bool measure_latency = true;  // Time each event's apply, two clock reads per event
+};
+
+struct ReplayStats
+{
+    uint64_t events = 0;
+    uint64_t applied = 0;         // Passed the books' update id sequencing
+    uint64_t unknown_symbols = 0; // No book registered for the event's symbol
+    int64_t elapsed_ns = 0;
+    int64_t max_lag_ns = 0;   // With recorded_timing, how far behind its schedule the latest event was applied
+    LatencyHistogram latency; // Nanoseconds to apply one event
+
+    double events_per_sec() const { return elapsed_ns > 0 ? static_cast<double>(events) * 1e9 / static_cast<double>(elapsed_ns) : 0.0; }
+};
+
+// Spin until the steady clock reaches deadline, sleeping through most of any long wait
+inline void wait_until_ns(int64_t deadline)
+{
+    for (int64_t now = steady_now_ns(); now < deadline; now = steady_now_ns()) {
+        if (deadline - now > 200'000)
+            std::this_thread::sleep_for(std::chrono::nanoseconds(deadline - now - 100'000));
+        else
+            cpu_relax();
+    }
+}
+
+template <typename Book>
+ReplayStats replay(CaptureReader& reader, BookRegistry<Book>& books, const ReplayOptions& options = {})
+{
+    ReplayStats stats;
+    CaptureEvent event;
+    const int64_t start = steady_now_ns();
+    int64_t first_timestamp = 0;
+
+    while (reader.next(event)) {
+        if (stats.events++ == 0)
+            first_timestamp = event.timestamp_ns;
+
+        if (options.recorded_timing) {
+            const auto due = start + static_cast<int64_t>(static_cast<double>(event.timestamp_ns - first_timestamp) / options.speed);
+            wait_until_ns(due);
+            stats.max_lag_ns = std::max(stats.max_lag_ns, steady_now_ns() - due);
+        }
+
+        Book* book = books.find(event.symbol);
+        if (book == nullptr) {
+            ++stats.unknown_symbols;
+            continue;
+        }
+
+        const int64_t before = options.measure_latency ? steady_now_ns() : 0;
+        const bool applied = event.type == CaptureRecordType::Depth
+            ? book->replace(event.update_id, event.bids, event.asks)
+            : book->update_bbo(event.update_id, event.bids[0], event.asks[0]);
+        if (options.measure_latency)
+            stats.latency.record(static_cast<uint64_t>(steady_now_ns() - before));
+        stats.applied += applied;
+    }
+
+    stats.elapsed_ns = steady_now_ns() - start;
+    return stats;
+}
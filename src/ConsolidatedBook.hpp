@@ -0,0 +1,186 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+
+#include "BinanceBook.hpp"
+#include "BookListener.hpp"
+#include "BookTraits.hpp"
+
+/*
+One book for an instrument across several venues, each with its own BinanceBook, with every price level showing
+how much of its quantity each venue has.
+
+Instead of merging every venue's extract() and sorting on each tick, the merged sides are kept up to date as the
+venues change, from the venues' own listeners (see BookListener.hpp). A venue's book is built with Feed as its
+listener policy and attach()ed to a venue number; from then on every level it inserts, changes or removes is
+applied to the merged side as it happens, each with a binary search and a shift. So the work is the levels that
+changed and nothing else: there's nothing to poll, and a venue that didn't update costs nothing. The merged sides
+are sorted worst level first, so the best level is the last one: changes at the top of the book, which are most of
+them, shift next to nothing, and the consolidated best bid/ask is a read of the last element.
+
+Prices are matched exactly, in decimal, so venues quoting the same tick share levels. The consolidated book is not
+uncrossed: one venue's bid above another's ask is an opportunity, not an error, and crossed() says so.
+
+The feeds hold a pointer to the consolidated book, so it has to stay where it is and outlive them (or have them
+detach()ed). Like the books, it's updated on the thread that updates them.
+*/
+
+template <size_t venues, size_t n>
+class ConsolidatedBook
+{
+public:
+    static constexpr size_t max_depth = n;        // Levels taken from each venue
+    static constexpr size_t max_levels = venues * n; // At most, a side
+
+    struct Level
+    {
+        Price price{};
+        Quantity quantity{}; // Over every venue
+        std::array<Quantity, venues> venue_quantity{};
+    };
+
+    /*
+    The listener policy for a venue's book, e.g. BinanceBook<n, RingSide, FloatingPointPricing, Consolidated::Feed<>>.
+    Pricing is the book's, to turn its levels into decimal prices. Does nothing until attach()ed.
+    */
+    template <typename Pricing = FloatingPointPricing>
+    struct Feed : BookListener<Feed<Pricing>>
+    {
+        template <typename BookLevel>
+        void on_level_changed(bool is_bid, const BookLevel& level)
+        {
+            if (target != nullptr)
+                target->set(venue, is_bid, pricing.to_decimal(level));
+        }
+
+        template <typename BookLevel>
+        void on_level_removed(bool is_bid, const BookLevel& level)
+        {
+            if (target != nullptr)
+                target->set(venue, is_bid, PriceQuantity{ pricing.to_decimal(level).price, 0 });
+        }
+
+        ConsolidatedBook* target = nullptr;
+        size_t venue = 0;
+        Pricing pricing{};
+    };
+
+    // i = 0 is the best level, up to depth() of them
+    const Level& bid(size_t i) const { return merged_bids[i]; }
+    const Level& ask(size_t i) const { return merged_asks[i]; }
+    std::pair<size_t, size_t> depth() const { return { merged_bids.size(), merged_asks.size() }; }
+
+    // O(1)
+    const Level* best_bid() const { return merged_bids.empty() ? nullptr : &merged_bids[0]; }
+    const Level* best_ask() const { return merged_asks.empty() ? nullptr : &merged_asks[0]; }
+
+    bool crossed() const { return best_bid() != nullptr && best_ask() != nullptr && best_bid()->price >= best_ask()->price; }
+
+    // Level changes applied from the feeds since the start, the measure of the work done
+    uint64_t level_updates() const { return updates; }
+
+    // Make book venue's source: whatever venue had is replaced with the book's current levels, and the book's
+    // updates flow in from now on. Its listener policy has to be a Feed.
+    template <typename Book>
+    void attach(size_t venue, Book& book)
+    {
+        clear_venue(venue);
+        auto& feed = book.listener_policy();
+        feed.target = this;
+        feed.venue = venue;
+        feed.pricing = book.pricing_policy();
+        for (const PriceQuantity& level : book.bid_view())
+            set(venue, /*is_bid=*/true, level);
+        for (const PriceQuantity& level : book.ask_view())
+            set(venue, /*is_bid=*/false, level);
+    }
+
+    // Stop following book, and take out everything its venue had
+    template <typename Book>
+    void detach(size_t venue, Book& book)
+    {
+        book.listener_policy().target = nullptr;
+        clear_venue(venue);
+    }
+
+    // The venue is gone (disconnected, halted), take out everything it had. A pass over the merged levels.
+    void clear_venue(size_t venue)
+    {
+        merged_bids.clear_venue(venue);
+        merged_asks.clear_venue(venue);
+    }
+
+private:
+    // Set venue's quantity at level.price, 0 meaning it has none there any more
+    void set(size_t venue, bool is_bid, const PriceQuantity& level)
+    {
+        ++updates;
+        if (is_bid)
+            merged_bids.set(venue, level);
+        else
+            merged_asks.set(venue, level);
+    }
+
+    // Merged levels of one side, worst first
+    template <typename BookSide>
+    class MergedSide
+    {
+    public:
+        size_t size() const { return count; }
+        bool empty() const { return count == 0; }
+        const Level& operator[](size_t i) const { return levels[count - 1 - i]; }
+
+        void set(size_t venue, const PriceQuantity& level)
+        {
+            Level* const end = levels.data() + count;
+            Level* const it = std::partition_point(levels.data(), end, [&](const Level& l) { return BookSide::better(level.price, l.price); });
+            if (it == end || it->price != level.price) {
+                if (level.quantity == 0)
+                    return;
+                std::copy_backward(it, end, end + 1);
+                *it = Level{ level.price, 0, {} };
+                ++count;
+            }
+            it->venue_quantity[venue] = level.quantity;
+            if (sum(*it) == 0) {
+                std::copy(it + 1, levels.data() + count, it);
+                --count;
+            }
+        }
+
+        void clear_venue(size_t venue)
+        {
+            size_t kept = 0;
+            for (size_t i = 0; i < count; ++i) {
+                Level& level = levels[i];
+                level.venue_quantity[venue] = 0;
+                if (sum(level) != 0)
+                    levels[kept++] = level;
+            }
+            count = kept;
+        }
+
+    private:
+        // Summed again rather than adjusted, so the total never drifts and is exactly 0 when no venue is left
+        static Quantity sum(Level& level)
+        {
+            Quantity total = 0;
+            for (const Quantity q : level.venue_quantity)
+                total += q;
+            return level.quantity = total;
+        }
+
+        // A snapshot reports a venue's new levels alongside the ones they replaced, in price order, so the venue can
+        // briefly have up to 2n: room for one more venue's worth
+        std::array<Level, max_levels + n> levels{};
+        size_t count = 0;
+    };
+
+    MergedSide<BidSide> merged_bids;
+    MergedSide<AskSide> merged_asks;
+    uint64_t updates = 0;
+};
@@ -0,0 +1,244 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <concepts>
+#include <cstddef>
+
+#include "LadderSide.hpp"
+#include "SideStorage.hpp"
+
+/*
+Side storage that also keeps running depth sums, so cumulative quantity/notional, depth imbalance and cost to fill
+are O(1)/O(log n) reads instead of a pass over extract().
+
+AnalyticSide<Inner> is any storage backend (RingSide, SoaSide) with every mutation wrapped to update the sums
+alongside it, so it drops into BinanceBook as its Storage: BinanceBook<20, AnalyticRingSide>. Books that don't query
+analytics keep a plain backend and pay nothing.
+Price-indexed storage (LadderSide) can't be wrapped, it doesn't compile: it drops levels by itself when its window
+moves, and sets and erases them by price, none of which would go through the sums.
+
+The sums are suffix sums, anchored rather than absolute: level i stores S[i] = anchor + (sum of levels i..back), and
+the best k levels sum to S[0] - S[k] (S[size()] being the anchor itself). The point is that every change the
+top-of-book path makes is O(1):
+ - push_front:         one new entry, S[1] + the new level
+ - drop_front:         nothing to rewrite, the entries behind keep their suffixes
+ - trim the worst:     the anchor absorbs its contribution instead of every entry losing it
+ - set_front_quantity: rewrite S[0]
+Inserts, erases and quantity changes deeper in the book (diff streams) rewrite the entries on the shorter side of
+the position, using the anchor the same way, so they're O(min(i, size - i)) just like the level shift they go with.
+The anchor wanders as levels come and go, so floating point sums would slowly lose precision relative to the
+actual depth. Every n anchor moves the whole array is rebased to a zero anchor, which is O(1) amortised.
+
+Sums are in the side's own units (ticks and lots for fixed-point books, as doubles); the book converts them.
+*/
+
+// Quantity and price * quantity, summed over some levels
+struct DepthSum
+{
+    double quantity = 0;
+    double notional = 0;
+
+    DepthSum operator+(const DepthSum& other) const { return { quantity + other.quantity, notional + other.notional }; }
+    DepthSum operator-(const DepthSum& other) const { return { quantity - other.quantity, notional - other.notional }; }
+    DepthSum& operator+=(const DepthSum& other) { return *this = *this + other; }
+    DepthSum& operator-=(const DepthSum& other) { return *this = *this - other; }
+};
+
+template <template <typename, size_t> class Inner, typename Level, size_t n>
+    requires (!PriceIndexedStorage<Inner<Level, n>>)
+class AnalyticSide : public Inner<Level, n>
+{
+    using Base = Inner<Level, n>;
+
+public:
+    using typename Base::Price;
+    using typename Base::Quantity;
+
+    using Base::size;
+
+    void clear()
+    {
+        Base::clear();
+        head = 0;
+        anchor = {};
+        anchor_moves = 0;
+    }
+
+    // Total of the best k levels (all of them if k >= size())
+    DepthSum depth(size_t k) const { return suffix(0) - suffix(std::min(k, size())); }
+
+    // How many of the best levels it takes to reach quantity, or size() + 1 if the whole side is less than that.
+    // Binary search over the prefix sums, O(log n).
+    size_t levels_to_fill(double quantity) const
+    {
+        const double top = suffix(0).quantity;
+        size_t first = 1, len = size();
+        while (len > 0) {
+            const size_t half = len / 2;
+            if (top - suffix(first + half).quantity < quantity) {
+                first += half + 1;
+                len -= half + 1;
+            }
+            else {
+                len = half;
+            }
+        }
+        return first;
+    }
+
+    void set_front_quantity(Quantity quantity)
+    {
+        Base::set_front_quantity(quantity);
+        sums[head] = suffix(1) + contribution(Base::front());
+    }
+
+    void drop_front(size_t k)
+    {
+        Base::drop_front(k);
+        head = (head + k) & mask;
+    }
+
+    void push_front(const Level& level)
+    {
+        if (size() == n)
+            trim_worst();
+        const DepthSum behind = suffix(0);
+        head = (head - 1) & mask;
+        sums[head] = behind + contribution(level);
+        Base::push_front(level);
+        settle();
+    }
+
+    void truncate(size_t k)
+    {
+        if (k < size())
+            move_anchor(suffix(k) - anchor);
+        Base::truncate(k);
+        settle();
+    }
+
+    // The new level's suffix is the old anchor, and the anchor moves down past it
+    void push_back(const Level& level)
+    {
+        sums[(head + size()) & mask] = anchor;
+        move_anchor(DepthSum{} - contribution(level));
+        Base::push_back(level);
+        settle();
+    }
+
+    // The levels up to i gain the difference. Whichever side of i is shorter is rewritten.
+    void set_quantity(size_t i, Quantity quantity)
+    {
+        const DepthSum old = contribution((*this)[i]);
+        Base::set_quantity(i, quantity);
+        const DepthSum change = contribution((*this)[i]) - old;
+        if (i < size() - i) {
+            for (size_t j = 0; j <= i; ++j)
+                at(j) += change;
+        }
+        else {
+            for (size_t j = i + 1; j < size(); ++j)
+                at(j) -= change;
+            move_anchor(DepthSum{} - change);
+            settle();
+        }
+    }
+
+    // Same split as the inner storage's insert: either the better levels shift up and gain the new level, or the
+    // worse ones shift down and the anchor absorbs it
+    void insert(size_t i, const Level& level)
+    {
+        if (size() == n)
+            trim_worst();
+        const size_t count = size();
+        const DepthSum c = contribution(level);
+        if (i < count - i) {
+            head = (head - 1) & mask;
+            for (size_t j = 0; j < i; ++j)
+                at(j) = at(j + 1) + c;
+        }
+        else {
+            for (size_t j = count; j > i; --j)
+                at(j) = at(j - 1) - c;
+            move_anchor(DepthSum{} - c);
+        }
+        at(i) = (i < count ? at(i + 1) : anchor) + c;
+        Base::insert(i, level);
+        settle();
+    }
+
+    void erase(size_t i)
+    {
+        const size_t count = size();
+        const DepthSum c = contribution((*this)[i]);
+        if (i < count - 1 - i) {
+            for (size_t j = i; j > 0; --j)
+                at(j) = at(j - 1) - c;
+            head = (head + 1) & mask;
+        }
+        else {
+            for (size_t j = i; j + 1 < count; ++j)
+                at(j) = at(j + 1) + c;
+            move_anchor(c);
+        }
+        Base::erase(i);
+        settle();
+    }
+
+private:
+    static constexpr size_t capacity = std::bit_ceil(n);
+    static constexpr size_t mask = capacity - 1;
+
+    static DepthSum contribution(const Level& level)
+    {
+        const auto quantity = static_cast<double>(level.quantity);
+        return { quantity, static_cast<double>(level.price) * quantity };
+    }
+
+    DepthSum& at(size_t i) { return sums[(head + i) & mask]; }
+    DepthSum suffix(size_t i) const { return i < size() ? sums[(head + i) & mask] : anchor; }
+
+    // Before the inner storage drops its worst level (push_front or insert at depth n)
+    void trim_worst()
+    {
+        move_anchor(contribution((*this)[n - 1]));
+        Base::truncate(n - 1);
+    }
+
+    void move_anchor(const DepthSum& by)
+    {
+        anchor += by;
+        ++anchor_moves;
+    }
+
+    // Once the sums and the levels agree again at the end of a mutation, rebase if the anchor has moved enough
+    void settle()
+    {
+        if (anchor_moves < n)
+            return;
+        for (size_t j = 0; j < size(); ++j)
+            at(j) -= anchor;
+        anchor = {};
+        anchor_moves = 0;
+    }
+
+    std::array<DepthSum, capacity> sums{};
+    size_t head = 0;
+    DepthSum anchor{};
+    size_t anchor_moves = 0;
+};
+
+template <typename Level, size_t n>
+using AnalyticRingSide = AnalyticSide<RingSide, Level, n>;
+
+template <typename Level, size_t n>
+using AnalyticSoaSide = AnalyticSide<SoaSide, Level, n>;
+
+// Storage the book can answer depth queries from
+template <typename Side>
+concept DepthAnalyticStorage = requires(const Side& side) {
+    { side.depth(size_t{}) } -> std::same_as<DepthSum>;
+    { side.levels_to_fill(double{}) } -> std::same_as<size_t>;
+};
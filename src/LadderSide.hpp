@@ -0,0 +1,334 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <type_traits>
+
+/*
+Side storage for deep books (thousands of levels from a diff stream) with fixed-point prices.
+
+RingSide and SoaSide keep the levels packed in price order, so a level inserted or erased mid-book shifts up to n/2
+others, which is fine at 20 levels and not at 5000. Here every tick in a window of `window` ticks has its own slot,
+direct-mapped from the price, plus one bit in an occupancy bitmap. Setting or clearing a level is O(1) whatever the
+depth, the best level is tracked (and found again with find-first-set when it goes), and the positional queries the
+book makes (count_better, the i-th level) are popcounts over the bitmap, with a count per block of 512 ticks so they
+only touch the words of one block past the block totals.
+
+Slots are numbered by distance from the best end of the window (the `origin` price), so slot 0 is the best price the
+window can hold for either side. The side needs to know which way is better for that, which the book tells it with
+orient() when it's constructed. When a new best price lands before the window (the market moved) the window is
+re-centred a quarter of its width behind it; levels that fall off the far end are dropped, like levels beyond depth n.
+A level worse than the window can hold is dropped too, after trying to slide the window back if the best has drifted
+away from the front. So the window should cover the price range of the depth being tracked: by default 4n ticks, and
+at least 1024.
+
+The book has to know when that happens, since the side is then only complete up to its new last level (see the
+horizon in BinanceBook::apply_level). So push_front(), push_back() and insert() take a callback that's given every
+level they drop, the worst one at depth n included, before it goes, and return whether the new level was held.
+
+Prices have to be integers (ticks), so this is for FixedPointPricing books.
+*/
+
+template <typename Level, size_t n, size_t window = std::max<size_t>(1024, std::bit_ceil(4 * n))>
+class BasicLadderSide
+{
+public:
+    using Price = decltype(Level::price);
+    using Quantity = decltype(Level::quantity);
+
+    static_assert(std::is_integral_v<Price>, "The tick ladder needs integer prices, use FixedPointPricing");
+    static_assert(std::has_single_bit(window) && window >= 512, "The window must be a power of two of at least 512 ticks");
+
+    // Which way is better, bids count down from the origin and asks up
+    void orient(bool bid_side) { is_bid = bid_side; }
+
+    size_t size() const { return count; }
+    bool empty() const { return count == 0; }
+
+    void clear()
+    {
+        bits.fill(0);
+        block_counts.fill(0);
+        count = 0;
+        best = worst = 0;
+    }
+
+    // i = 0 is the best level. A select over the bitmap, except for the front.
+    Level operator[](size_t i) const
+    {
+        const size_t slot = i == 0 ? best : select(i);
+        return { price_at(slot), quantities[slot] };
+    }
+
+    Level front() const { return { price_at(best), quantities[best] }; }
+    void set_front_quantity(Quantity quantity) { quantities[best] = quantity; }
+
+    // Levels strictly better than price: the occupied slots before its slot
+    size_t count_better(Price price, bool) const
+    {
+        if (count == 0)
+            return 0;
+        const int64_t slot = slot_of(price);
+        if (slot <= 0)
+            return 0;
+        if (slot >= static_cast<int64_t>(window))
+            return count;
+        return rank(static_cast<size_t>(slot));
+    }
+
+    void drop_front(size_t k)
+    {
+        for (; k > 0; --k)
+            clear_slot(best);
+    }
+
+    // Does nothing with the levels a push drops
+    struct IgnoreDropped
+    {
+        void operator()(const Level&) const {}
+    };
+
+    template <typename Dropped = IgnoreDropped>
+    bool push_front(const Level& level, Dropped&& dropped = {})
+    {
+        return add(level, dropped);
+    }
+
+    void truncate(size_t k)
+    {
+        while (count > k)
+            clear_slot(worst);
+    }
+
+    template <typename Dropped = IgnoreDropped>
+    bool push_back(const Level& level, Dropped&& dropped = {})
+    {
+        return add(level, dropped);
+    }
+
+    void set_quantity(size_t i, Quantity quantity) { quantities[i == 0 ? best : select(i)] = quantity; }
+
+    // The position is implied by the price
+    template <typename Dropped = IgnoreDropped>
+    bool insert(size_t, const Level& level, Dropped&& dropped = {})
+    {
+        return add(level, dropped);
+    }
+
+    void erase(size_t i) { clear_slot(i == 0 ? best : select(i)); }
+
+    // Price-keyed access, all O(1). The book uses these for diff-depth levels instead of going through positions.
+
+    std::optional<Level> find(Price price) const
+    {
+        const int64_t slot = slot_of(price);
+        if (count == 0 || slot < 0 || slot >= static_cast<int64_t>(window) || !occupied(static_cast<size_t>(slot)))
+            return std::nullopt;
+        return Level{ price, quantities[static_cast<size_t>(slot)] };
+    }
+
+    // The price must be in the side (find() says so)
+    void set_quantity_at(Price price, Quantity quantity) { quantities[static_cast<size_t>(slot_of(price))] = quantity; }
+    void erase_at(Price price) { clear_slot(static_cast<size_t>(slot_of(price))); }
+
+    // The worst level
+    Level back() const { return { price_at(worst), quantities[worst] }; }
+
+private:
+    static constexpr size_t word_bits = 64;
+    static constexpr size_t words = window / word_bits;
+    static constexpr size_t block_bits = 512;
+    static constexpr size_t block_words = block_bits / word_bits;
+    static constexpr size_t blocks = window / block_bits;
+
+    Price price_at(size_t slot) const
+    {
+        const auto offset = static_cast<Price>(slot);
+        return is_bid ? origin - offset : origin + offset;
+    }
+
+    int64_t slot_of(Price price) const { return is_bid ? origin - price : price - origin; }
+
+    // Slot for price, moving the window if it has to (levels pushed off its far end go to dropped). window if the
+    // level can't be held.
+    template <typename Dropped>
+    size_t place(Price price, Dropped& dropped)
+    {
+        constexpr auto margin = static_cast<int64_t>(window / 4);
+        if (count == 0) {
+            origin = is_bid ? price + margin : price - margin;
+            return static_cast<size_t>(margin);
+        }
+        int64_t slot = slot_of(price);
+        if (slot < 0) {
+            shift(margin - slot, dropped);
+            slot = margin;
+        }
+        else if (slot >= static_cast<int64_t>(window) && static_cast<int64_t>(best) > margin) {
+            const int64_t by = margin - static_cast<int64_t>(best);
+            shift(by, dropped);
+            slot += by;
+        }
+        return slot < static_cast<int64_t>(window) ? static_cast<size_t>(slot) : window;
+    }
+
+    bool occupied(size_t slot) const { return (bits[slot / word_bits] >> (slot % word_bits)) & 1; }
+
+    // The window is placed first, so a full side only gives up its worst level once the new one has a slot, and
+    // only if the new one is better than it
+    template <typename Dropped>
+    bool add(const Level& level, Dropped& dropped)
+    {
+        const size_t slot = place(level.price, dropped);
+        if (slot == window)
+            return false;
+        if (occupied(slot)) {
+            quantities[slot] = level.quantity; // Already there, the quantity was all that changed
+            return true;
+        }
+        if (count == n) {
+            if (slot > worst)
+                return false;
+            dropped(back());
+            clear_slot(worst);
+        }
+        quantities[slot] = level.quantity;
+        bits[slot / word_bits] |= uint64_t{ 1 } << (slot % word_bits);
+        ++block_counts[slot / block_bits];
+        if (count++ == 0) {
+            best = worst = slot;
+            return true;
+        }
+        best = std::min(best, slot);
+        worst = std::max(worst, slot);
+        return true;
+    }
+
+    void clear_slot(size_t slot)
+    {
+        bits[slot / word_bits] &= ~(uint64_t{ 1 } << (slot % word_bits));
+        --block_counts[slot / block_bits];
+        if (--count == 0) {
+            best = worst = 0;
+            return;
+        }
+        if (slot == best)
+            best = first_set_from(slot + 1);
+        else if (slot == worst)
+            worst = last_set_from(slot - 1);
+    }
+
+    // First occupied slot at or after slot, find-first-set a word at a time. The caller knows there is one.
+    size_t first_set_from(size_t slot) const
+    {
+        size_t w = slot / word_bits;
+        uint64_t word = bits[w] & (~uint64_t{ 0 } << (slot % word_bits));
+        while (word == 0)
+            word = bits[++w];
+        return w * word_bits + static_cast<size_t>(std::countr_zero(word));
+    }
+
+    // Last occupied slot at or before slot
+    size_t last_set_from(size_t slot) const
+    {
+        size_t w = slot / word_bits;
+        uint64_t word = bits[w] & (~uint64_t{ 0 } >> (word_bits - 1 - slot % word_bits));
+        while (word == 0)
+            word = bits[--w];
+        return w * word_bits + word_bits - 1 - static_cast<size_t>(std::countl_zero(word));
+    }
+
+    // Occupied slots before slot
+    size_t rank(size_t slot) const
+    {
+        size_t total = 0;
+        const size_t block = slot / block_bits;
+        for (size_t b = 0; b < block; ++b)
+            total += block_counts[b];
+        const size_t w = slot / word_bits;
+        for (size_t i = block * block_words; i < w; ++i)
+            total += static_cast<size_t>(std::popcount(bits[i]));
+        return total + static_cast<size_t>(std::popcount(bits[w] & ((uint64_t{ 1 } << (slot % word_bits)) - 1)));
+    }
+
+    // Slot of the i-th occupied slot. Stays inside the window even if i >= count (a torn read, see SideStorage.hpp).
+    size_t select(size_t i) const
+    {
+        size_t b = 0;
+        while (b + 1 < blocks && i >= block_counts[b])
+            i -= block_counts[b++];
+        size_t w = b * block_words;
+        for (; w + 1 < words; ++w) {
+            const auto in_word = static_cast<size_t>(std::popcount(bits[w]));
+            if (i < in_word)
+                break;
+            i -= in_word;
+        }
+        uint64_t word = bits[w];
+        for (; i > 0 && word != 0; --i)
+            word &= word - 1;
+        return word == 0 ? w * word_bits : w * word_bits + static_cast<size_t>(std::countr_zero(word));
+    }
+
+    // Move every level `by` slots further from the front (closer if negative), passing the ones that leave the
+    // window to dropped. Walks the levels from the end they move towards so none is overwritten before it has moved.
+    template <typename Dropped>
+    void shift(int64_t by, Dropped& dropped)
+    {
+        std::array<uint64_t, words> moved{};
+        const auto move = [&](size_t slot) {
+            const int64_t to = static_cast<int64_t>(slot) + by;
+            if (to < 0 || to >= static_cast<int64_t>(window)) {
+                dropped(Level{ price_at(slot), quantities[slot] });
+                return;
+            }
+            quantities[static_cast<size_t>(to)] = quantities[slot];
+            moved[static_cast<size_t>(to) / word_bits] |= uint64_t{ 1 } << (static_cast<size_t>(to) % word_bits);
+        };
+        for (size_t i = 0; i < words; ++i) {
+            const size_t w = by > 0 ? words - 1 - i : i;
+            for (uint64_t word = bits[w]; word != 0;) {
+                const size_t bit = by > 0 ? word_bits - 1 - static_cast<size_t>(std::countl_zero(word)) : static_cast<size_t>(std::countr_zero(word));
+                word &= ~(uint64_t{ 1 } << bit);
+                move(w * word_bits + bit);
+            }
+        }
+
+        origin = is_bid ? origin + static_cast<Price>(by) : origin - static_cast<Price>(by);
+        bits = moved;
+        block_counts.fill(0);
+        count = 0;
+        for (size_t w = 0; w < words; ++w) {
+            const auto in_word = static_cast<size_t>(std::popcount(bits[w]));
+            block_counts[w / block_words] += static_cast<uint16_t>(in_word);
+            count += in_word;
+        }
+        best = count != 0 ? first_set_from(0) : 0;
+        worst = count != 0 ? last_set_from(window - 1) : 0;
+    }
+
+    std::array<uint64_t, words> bits{};
+    std::array<uint16_t, blocks> block_counts{};
+    std::array<Quantity, window> quantities{};
+    Price origin{};
+    size_t count = 0;
+    size_t best = 0;  // Occupied slot closest to the front, when count > 0
+    size_t worst = 0; // And furthest from it
+    bool is_bid = true;
+};
+
+template <typename Level, size_t n>
+using LadderSide = BasicLadderSide<Level, n>;
+
+// Storage that can find a level by price without a search, see BinanceBook::apply_level
+template <typename Side>
+concept PriceIndexedStorage = requires(Side& side, const Side& const_side, typename Side::Price price, typename Side::Quantity quantity) {
+    const_side.find(price);
+    const_side.back();
+    side.set_quantity_at(price, quantity);
+    side.erase_at(price);
+};
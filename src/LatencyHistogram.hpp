@@ -0,0 +1,71 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+
+/*
+Fixed-size log-linear latency histogram, in the spirit of HdrHistogram.
+
+Values below 2^sub_bits are counted exactly. Above that each power of two is split into 2^sub_bits equal buckets, so
+a recorded value is known to within ~3% whatever its magnitude, and the whole histogram is one flat array: recording
+is a bit_width and an increment, never an allocation. The exact max and sum are kept alongside.
+*/
+class LatencyHistogram
+{
+public:
+    void record(uint64_t value)
+    {
+        ++buckets[index_of(value)];
+        ++total;
+        sum += value;
+        largest = std::max(largest, value);
+    }
+
+    uint64_t count() const { return total; }
+    uint64_t max() const { return largest; }
+    double mean() const { return total == 0 ? 0.0 : static_cast<double>(sum) / static_cast<double>(total); }
+
+    // Smallest bucket bound that at least q (0..1] of the recorded values fall under
+    uint64_t percentile(double q) const
+    {
+        if (total == 0)
+            return 0;
+        const auto target = std::max<uint64_t>(1, static_cast<uint64_t>(q * static_cast<double>(total) + 0.5));
+        uint64_t seen = 0;
+        for (size_t i = 0; i < buckets.size(); ++i) {
+            seen += buckets[i];
+            if (seen >= target)
+                return std::min(upper_bound_of(i), largest);
+        }
+        return largest;
+    }
+
+private:
+    static constexpr int sub_bits = 5;
+    static constexpr uint64_t sub_count = uint64_t{ 1 } << sub_bits;
+
+    static size_t index_of(uint64_t value)
+    {
+        if (value < sub_count)
+            return static_cast<size_t>(value);
+        const int shift = std::bit_width(value) - 1 - sub_bits;
+        return static_cast<size_t>((shift + 1) * sub_count + ((value >> shift) - sub_count));
+    }
+
+    static uint64_t upper_bound_of(size_t index)
+    {
+        if (index < sub_count)
+            return index;
+        const auto shift = static_cast<int>(index / sub_count) - 1;
+        const uint64_t mantissa = index % sub_count + sub_count;
+        return ((mantissa + 1) << shift) - 1;
+    }
+
+    std::array<uint64_t, (64 - sub_bits + 1) * sub_count> buckets{};
+    uint64_t total = 0;
+    uint64_t sum = 0;
+    uint64_t largest = 0;
+};
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#else
+#include <fstream>
+#include <iterator>
+#endif
+
+/*
+A whole file mapped read-only, for the readers of the files this library writes (CaptureReader, CheckpointReader).
+With sequential set the kernel is told the file will be read front to back, so it reads ahead.
+Without mmap (non-POSIX builds) the file is read into memory instead. A file that can't be opened, or is empty,
+is just no bytes.
+*/
+class MappedFile
+{
+public:
+    explicit MappedFile(const std::string& path, bool sequential = false)
+    {
+#if defined(__unix__) || defined(__APPLE__)
+        const int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+            return;
+        struct stat st{};
+        if (::fstat(fd, &st) == 0 && st.st_size > 0) {
+            void* mapping = ::mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+            if (mapping != MAP_FAILED) {
+                if (sequential)
+                    ::madvise(mapping, static_cast<size_t>(st.st_size), MADV_SEQUENTIAL);
+                bytes = static_cast<const std::byte*>(mapping);
+                length = static_cast<size_t>(st.st_size);
+            }
+        }
+        ::close(fd);
+#else
+        (void)sequential;
+        std::ifstream in(path, std::ios::binary);
+        contents.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+        bytes = reinterpret_cast<const std::byte*>(contents.data());
+        length = contents.size();
+#endif
+    }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    ~MappedFile()
+    {
+#if defined(__unix__) || defined(__APPLE__)
+        if (bytes != nullptr)
+            ::munmap(const_cast<std::byte*>(bytes), length);
+#endif
+    }
+
+    const std::byte* data() const { return bytes; }
+    size_t size() const { return length; }
+
+private:
+    const std::byte* bytes = nullptr;
+    size_t length = 0;
+#if !(defined(__unix__) || defined(__APPLE__))
+    std::vector<char> contents;
+#endif
+};
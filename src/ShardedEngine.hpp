@@ -0,0 +1,256 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <stdexcept>
+#include <string_view>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#if defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+#include "BinanceParser.hpp"
+#include "BookRegistry.hpp"
+#include "SpscQueue.hpp"
+#include "SymbolIndex.hpp"
+
+/*
+Spreads books across worker threads so updates for different symbols are applied in parallel.
+
+Each symbol is assigned to one shard (round robin as symbols are added), and only that shard's worker thread ever
+touches its books, so the books themselves need no synchronisation at all. A single router thread - whoever calls
+on_book_ticker()/on_depth() - parses each message, looks the symbol up, and hands the parsed update to the owning
+shard through that shard's SPSC ring. Nothing is shared between shards, so throughput scales with cores until the
+router itself is the bottleneck.
+
+Depth snapshots are parsed straight into the ring slot. Tickers have to be parsed before we know where they go, but
+only the small ticker part of the slot is written then.
+
+Options:
+ - pin_threads: pin shard i to core first_core + i (Linux only, ignored elsewhere).
+ - busy_poll: workers spin on their ring (lowest latency, burns a core each) or block until the router wakes them.
+*/
+
+struct EngineOptions
+{
+    size_t shards = 1; // 1 to 1024
+    size_t books_per_shard = 1024; // Under 2^22
+    bool pin_threads = false;
+    int first_core = 0;
+    bool busy_poll = true;
+};
+
+template <typename Book, size_t QueueCapacity = 1024>
+class ShardedEngine
+{
+public:
+    // Throws std::invalid_argument if shards or books_per_shard don't fit the routes (see EngineOptions)
+    explicit ShardedEngine(const EngineOptions& options)
+        : options(checked(options)), symbols(options.shards * options.books_per_shard)
+    {
+        for (size_t i = 0; i < options.shards; ++i)
+            shards.push_back(std::make_unique<Shard>(options.books_per_shard));
+    }
+
+    ShardedEngine(const ShardedEngine&) = delete;
+    ShardedEngine& operator=(const ShardedEngine&) = delete;
+
+    ~ShardedEngine() { stop(); }
+
+    // Register a symbol before start(), passing args to its book's constructor.
+    // Returns false if it's already registered, too long, or its shard is full.
+    template <typename... Args>
+    bool add(std::string_view symbol, Args&&... args)
+    {
+        const size_t shard = next_shard;
+        Shard& target = *shards[shard];
+        if (symbols.find(symbol) != SymbolIndex::npos || target.books.size() == target.books.capacity())
+            return false;
+        const auto book = static_cast<uint32_t>(target.books.size());
+        // The registry refuses the same symbols the index does (empty or too long), and the index has room for every
+        // shard's books, so once the book is added the insert goes through
+        if (target.books.add(symbol, std::forward<Args>(args)...) == nullptr || !symbols.insert(symbol, encode(shard, book)))
+            return false;
+        next_shard = (next_shard + 1) % shards.size();
+        return true;
+    }
+
+    void start()
+    {
+        running.store(true, std::memory_order_release);
+        for (size_t i = 0; i < shards.size(); ++i)
+            shards[i]->thread = std::thread([this, i] { run_shard(i); });
+    }
+
+    // Stops once every update routed so far has been applied
+    void stop()
+    {
+        if (!running.exchange(false))
+            return;
+        for (auto& shard : shards) {
+            shard->queue.notify();
+            shard->thread.join();
+        }
+    }
+
+    // Router thread only. Returns false if the message didn't parse or its symbol isn't registered.
+    bool on_book_ticker(std::string_view json)
+    {
+        TickerMessage message;
+        if (!parse_book_ticker(json, message))
+            return false;
+        const uint32_t route = symbols.find(message.symbol);
+        if (route == SymbolIndex::npos)
+            return false;
+
+        Shard& shard = *shards[shard_of(route)];
+        Event& event = claim(shard);
+        event.type = MessageType::BookTicker;
+        event.book = book_of(route);
+        event.ticker = message;
+        event.ticker.symbol = {}; // Points into the router's buffer, which won't outlive this call
+        publish(shard);
+        return true;
+    }
+
+    // Router thread only. Depth payloads don't carry their symbol, so the caller passes it.
+    bool on_depth(std::string_view symbol, std::string_view json)
+    {
+        const uint32_t route = symbols.find(symbol);
+        if (route == SymbolIndex::npos)
+            return false;
+
+        Shard& shard = *shards[shard_of(route)];
+        Event& event = claim(shard);
+        if (!parse_depth(json, event.depth))
+            return false; // Slot isn't published, the next message reuses it
+        event.type = MessageType::Depth;
+        event.book = book_of(route);
+        publish(shard);
+        return true;
+    }
+
+    size_t shard_count() const { return shards.size(); }
+
+    // Updates applied by a shard so far, safe to read while running
+    uint64_t processed(size_t shard) const { return shards[shard]->processed.load(std::memory_order_relaxed); }
+
+    // Times the router found a shard's ring full and had to wait for it
+    uint64_t router_stalls() const { return stalls; }
+
+    // Only safe once stopped (or before start()), the shard threads own the books while running
+    Book* find(std::string_view symbol)
+    {
+        const uint32_t route = symbols.find(symbol);
+        return route == SymbolIndex::npos ? nullptr : &shards[shard_of(route)]->books.at(book_of(route));
+    }
+
+private:
+    struct Event
+    {
+        MessageType type = MessageType::Unknown;
+        uint32_t book = 0;
+        TickerMessage ticker;
+        DepthMessage<Book::max_depth> depth;
+    };
+
+    struct alignas(64) Shard
+    {
+        explicit Shard(size_t capacity) : books(capacity) {}
+
+        BookRegistry<Book> books;
+        SpscQueue<Event, QueueCapacity> queue;
+        std::thread thread;
+        alignas(64) std::atomic<uint64_t> processed{ 0 };
+    };
+
+    // The symbol index maps to shard and book index packed into one value
+    static constexpr uint32_t shard_bits = 10;
+    static uint32_t encode(size_t shard, uint32_t book) { return (book << shard_bits) | static_cast<uint32_t>(shard); }
+    static size_t shard_of(uint32_t route) { return route & ((1u << shard_bits) - 1); }
+    static uint32_t book_of(uint32_t route) { return route >> shard_bits; }
+
+    // Every shard has to fit in shard_bits and every book in the rest, short of the all-ones npos
+    static const EngineOptions& checked(const EngineOptions& options)
+    {
+        if (options.shards == 0 || options.shards > (size_t{ 1 } << shard_bits))
+            throw std::invalid_argument("ShardedEngine: shards must be between 1 and 1024");
+        if (options.books_per_shard >= (size_t{ 1 } << (32 - shard_bits)))
+            throw std::invalid_argument("ShardedEngine: books_per_shard must be under 2^22");
+        return options;
+    }
+
+    // Backpressure: if a shard falls behind, the router waits for it rather than dropping updates
+    Event& claim(Shard& shard)
+    {
+        Event* event = shard.queue.claim();
+        if (event == nullptr) [[unlikely]] {
+            ++stalls;
+            while ((event = shard.queue.claim()) == nullptr)
+                cpu_relax();
+        }
+        return *event;
+    }
+
+    void publish(Shard& shard)
+    {
+        shard.queue.publish();
+        if (!options.busy_poll)
+            shard.queue.notify();
+    }
+
+    void run_shard(size_t index)
+    {
+        pin_to_core(index);
+        Shard& shard = *shards[index];
+        uint64_t processed = 0;
+        for (;;) {
+            Event* event = shard.queue.front();
+            if (event == nullptr) {
+                const uint32_t ticket = options.busy_poll ? 0 : shard.queue.wait_ticket();
+                if (!running.load(std::memory_order_seq_cst) && shard.queue.empty())
+                    return;
+                if (options.busy_poll)
+                    cpu_relax();
+                else
+                    shard.queue.wait(ticket);
+                continue;
+            }
+
+            Book& book = shard.books.at(event->book);
+            if (event->type == MessageType::BookTicker)
+                apply_book_ticker(event->ticker, book);
+            else
+                apply_depth(event->depth, book);
+            shard.queue.pop();
+            shard.processed.store(++processed, std::memory_order_relaxed);
+        }
+    }
+
+    void pin_to_core(size_t index) const
+    {
+#if defined(__linux__)
+        if (!options.pin_threads)
+            return;
+        cpu_set_t cpus;
+        CPU_ZERO(&cpus);
+        CPU_SET(static_cast<int>(options.first_core + index) % CPU_SETSIZE, &cpus);
+        pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+#else
+        (void)index;
+#endif
+    }
+
+    EngineOptions options;
+    SymbolIndex symbols; // Router's view: symbol -> (shard, book)
+    std::vector<std::unique_ptr<Shard>> shards;
+    size_t next_shard = 0;
+    uint64_t stalls = 0;
+    std::atomic<bool> running{ false };
+};
@@ -0,0 +1,269 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstddef>
+
+#include "SimdKernels.hpp"
+
+/*
+Storage for one side of a BinanceBook.
+
+Every mutation the book makes to a side on the snapshot/BBO path is one of:
+ - drop a prefix of levels (those better than a new top of book, or crossed by the other side's new top)
+ - push a new best level onto the front
+ - trim the worst levels off the back to stay within depth n
+ - overwrite the whole side from a snapshot
+A circular buffer makes the first three O(1) with no element shifting, and sizing it from the template depth means
+the levels live inline in the book with no heap allocation at all.
+Diff-depth updates can also insert or erase a level anywhere (insert/erase). Those shift whichever part of the side
+is shorter, the levels before the position or the ones after it, so at most n/2 levels move.
+
+Reads (operator[], front) must stay inside the storage even when head/count are read halfway through an update,
+because SeqlockBook readers run concurrently with the writer and only discard what they read afterwards.
+
+Every backend has the same interface so BinanceBook can take it as a template parameter:
+ - RingSide: interleaved price/quantity levels in a circular buffer, binary search for positions.
+ - SoaSide: prices and quantities in separate aligned arrays so positions can be found with vector compares.
+ - LadderSide (LadderSide.hpp): a slot per tick and an occupancy bitmap, for deep fixed-point books.
+*/
+
+template <typename Level, size_t n>
+class RingSide
+{
+    static_assert(n > 0, "A book side needs at least one level");
+
+public:
+    using Price = decltype(Level::price);
+    using Quantity = decltype(Level::quantity);
+
+    // Power of two so wrapping an index is a mask instead of a modulo
+    static constexpr size_t capacity = std::bit_ceil(n);
+
+    size_t size() const { return count; }
+    bool empty() const { return count == 0; }
+    void clear() { head = 0; count = 0; }
+
+    // i = 0 is the best level
+    const Level& operator[](size_t i) const { return levels[(head + i) & mask]; }
+
+    const Level& front() const { return levels[head]; }
+    void set_front_quantity(Quantity quantity) { levels[head].quantity = quantity; }
+
+    // Number of leading levels strictly better than price, ie the std::lower_bound position of price on this side.
+    // For bids better means higher, for asks better means lower.
+    size_t count_better(Price price, bool is_bid) const
+    {
+        size_t first = 0;
+        size_t len = count;
+        while (len > 0) {
+            const size_t half = len / 2;
+            const Price p = (*this)[first + half].price;
+            if (is_bid ? p > price : p < price) {
+                first += half + 1;
+                len -= half + 1;
+            }
+            else {
+                len = half;
+            }
+        }
+        return first;
+    }
+
+    // Remove the k best levels
+    void drop_front(size_t k)
+    {
+        head = (head + k) & mask;
+        count -= k;
+    }
+
+    // Insert a new best level, dropping the worst one if we are already at depth n
+    void push_front(const Level& level)
+    {
+        if (count == n)
+            --count;
+        head = (head - 1) & mask;
+        levels[head] = level;
+        ++count;
+    }
+
+    // Keep only the k best levels
+    void truncate(size_t k) { count = std::min(count, k); }
+
+    // Append a level worse than all current ones, used to load a snapshot. The caller keeps size() <= n.
+    void push_back(const Level& level)
+    {
+        levels[(head + count) & mask] = level;
+        ++count;
+    }
+
+    void set_quantity(size_t i, Quantity quantity) { levels[(head + i) & mask].quantity = quantity; }
+
+    // Insert level at position i (i < size()), dropping the worst level if we are already at depth n
+    void insert(size_t i, const Level& level)
+    {
+        if (count == n)
+            --count;
+        if (i < count - i) {
+            head = (head - 1) & mask;
+            for (size_t j = 0; j < i; ++j)
+                levels[(head + j) & mask] = levels[(head + j + 1) & mask];
+        }
+        else {
+            for (size_t j = count; j > i; --j)
+                levels[(head + j) & mask] = levels[(head + j - 1) & mask];
+        }
+        levels[(head + i) & mask] = level;
+        ++count;
+    }
+
+    void erase(size_t i)
+    {
+        if (i < count - 1 - i) {
+            for (size_t j = i; j > 0; --j)
+                levels[(head + j) & mask] = levels[(head + j - 1) & mask];
+            head = (head + 1) & mask;
+        }
+        else {
+            for (size_t j = i; j + 1 < count; ++j)
+                levels[(head + j) & mask] = levels[(head + j + 1) & mask];
+        }
+        --count;
+    }
+
+private:
+    static constexpr size_t mask = capacity - 1;
+
+    std::array<Level, capacity> levels{};
+    size_t head = 0;
+    size_t count = 0;
+};
+
+template <typename Level, size_t n>
+class SoaSide
+{
+    static_assert(n > 0, "A book side needs at least one level");
+
+public:
+    using Price = decltype(Level::price);
+    using Quantity = decltype(Level::quantity);
+
+    size_t size() const { return count; }
+    bool empty() const { return count == 0; }
+    void clear() { head = n; count = 0; }
+
+    // i = 0 is the best level. Levels aren't stored as a struct so these return by value.
+    // Clamped so a torn head/count (see above) can't index past the window.
+    Level operator[](size_t i) const
+    {
+        const size_t slot = std::min(head + i, window - 1);
+        return { prices[slot], quantities[slot] };
+    }
+
+    Level front() const { return (*this)[0]; }
+    void set_front_quantity(Quantity quantity) { quantities[head] = quantity; }
+
+    // Same meaning as RingSide::count_better, but done with SIMD compares over the price array
+    size_t count_better(Price price, bool is_bid) const { return ::count_better(prices.data() + head, count, price, is_bid); }
+
+    void drop_front(size_t k)
+    {
+        head += k;
+        count -= k;
+    }
+
+    void push_front(const Level& level)
+    {
+        if (count == n)
+            --count;
+        if (head == 0) [[unlikely]]
+            recenter();
+        --head;
+        prices[head] = level.price;
+        quantities[head] = level.quantity;
+        ++count;
+    }
+
+    void truncate(size_t k) { count = std::min(count, k); }
+
+    // The caller keeps size() <= n. Appending after a run of drop_front() can reach the end of the window, then the
+    // levels slide back to the middle first.
+    void push_back(const Level& level)
+    {
+        if (head + count == 2 * n) [[unlikely]]
+            recenter();
+        prices[head + count] = level.price;
+        quantities[head + count] = level.quantity;
+        ++count;
+    }
+
+    void set_quantity(size_t i, Quantity quantity) { quantities[head + i] = quantity; }
+
+    // Insert level at position i (i < size()), dropping the worst level if we are already at depth n.
+    // Shifting the front moves head down like push_front, shifting the back needs room before the end of the window.
+    void insert(size_t i, const Level& level)
+    {
+        if (count == n)
+            --count;
+        if (i < count - i || head + count == 2 * n) {
+            if (head == 0) [[unlikely]]
+                recenter();
+            std::copy(prices.begin() + head, prices.begin() + head + i, prices.begin() + head - 1);
+            std::copy(quantities.begin() + head, quantities.begin() + head + i, quantities.begin() + head - 1);
+            --head;
+        }
+        else {
+            std::copy_backward(prices.begin() + head + i, prices.begin() + head + count, prices.begin() + head + count + 1);
+            std::copy_backward(quantities.begin() + head + i, quantities.begin() + head + count, quantities.begin() + head + count + 1);
+        }
+        prices[head + i] = level.price;
+        quantities[head + i] = level.quantity;
+        ++count;
+    }
+
+    void erase(size_t i)
+    {
+        if (i < count - 1 - i) {
+            std::copy_backward(prices.begin() + head, prices.begin() + head + i, prices.begin() + head + i + 1);
+            std::copy_backward(quantities.begin() + head, quantities.begin() + head + i, quantities.begin() + head + i + 1);
+            ++head;
+        }
+        else {
+            std::copy(prices.begin() + head + i + 1, prices.begin() + head + count, prices.begin() + head + i);
+            std::copy(quantities.begin() + head + i + 1, quantities.begin() + head + count, quantities.begin() + head + i);
+        }
+        --count;
+    }
+
+private:
+    /*
+    Levels live in [head, head + count) of a window of 2n slots. Dropping the front moves head up and pushing a new
+    best moves it down, so head + count never grows past 2n. Once head reaches the start of the window (or, appending
+    diff-depth levels, the end) we slide the levels back to the middle, after which about n/2 pushes can happen
+    before the next slide, so that's amortised O(1).
+    */
+    void recenter()
+    {
+        // count < n whenever this is called, so the new head is at least n/2 from either end
+        const size_t centered = (2 * n - count) / 2;
+        if (centered < head) {
+            std::copy(prices.begin() + head, prices.begin() + head + count, prices.begin() + centered);
+            std::copy(quantities.begin() + head, quantities.begin() + head + count, quantities.begin() + centered);
+        }
+        else {
+            std::copy_backward(prices.begin() + head, prices.begin() + head + count, prices.begin() + centered + count);
+            std::copy_backward(quantities.begin() + head, quantities.begin() + head + count, quantities.begin() + centered + count);
+        }
+        head = centered;
+    }
+
+    // The kernels load whole vectors, so leave room for a full vector past the last level
+    static constexpr size_t padding = 4;
+    static constexpr size_t window = 2 * n + padding;
+
+    alignas(64) std::array<Price, window> prices{};
+    alignas(64) std::array<Quantity, window> quantities{};
+    size_t head = n;
+    size_t count = 0;
+};
@@ -0,0 +1,117 @@
+#pragma once
+
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+/*
+Search kernels over a sorted, contiguous array of prices.
+
+A side is sorted best first, so the levels "better" than a given price (higher for bids, lower for asks) always form
+a prefix. That means we don't need a branchy binary search: compare every price against the target in parallel,
+and the number of set bits in the comparison mask is the prefix length, ie the std::lower_bound position.
+Lanes past `count` hold stale data, so the last mask is cut down to the valid lanes.
+*/
+
+// Portable version, also used for price types there is no vector kernel for
+template <typename Price>
+inline size_t count_better_scalar(const Price* prices, size_t count, Price price, bool is_bid)
+{
+    size_t i = 0;
+    if (is_bid)
+        while (i < count && prices[i] > price) ++i;
+    else
+        while (i < count && prices[i] < price) ++i;
+    return i;
+}
+
+template <typename Price>
+inline size_t count_better(const Price* prices, size_t count, Price price, bool is_bid)
+{
+    return count_better_scalar(prices, count, price, is_bid);
+}
+
+#if defined(__AVX2__)
+
+// 4 doubles per compare, so a 20 level side is 5 compares
+inline size_t count_better(const double* prices, size_t count, double price, bool is_bid)
+{
+    const __m256d target = _mm256_set1_pd(price);
+    size_t result = 0;
+    for (size_t i = 0; i < count; i += 4) {
+        const __m256d v = _mm256_loadu_pd(prices + i);
+        const __m256d m = is_bid ? _mm256_cmp_pd(v, target, _CMP_GT_OQ) : _mm256_cmp_pd(v, target, _CMP_LT_OQ);
+        unsigned bits = static_cast<unsigned>(_mm256_movemask_pd(m));
+        if (count - i < 4)
+            bits &= (1u << (count - i)) - 1;
+        result += std::popcount(bits);
+        if (bits != 0xF) // The prefix ended inside this block
+            break;
+    }
+    return result;
+}
+
+// Fixed-point prices, an exact integer compare. AVX2 only has a signed greater-than, so asks swap the operands.
+inline size_t count_better(const int64_t* prices, size_t count, int64_t price, bool is_bid)
+{
+    const __m256i target = _mm256_set1_epi64x(price);
+    size_t result = 0;
+    for (size_t i = 0; i < count; i += 4) {
+        const __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(prices + i));
+        const __m256i m = is_bid ? _mm256_cmpgt_epi64(v, target) : _mm256_cmpgt_epi64(target, v);
+        unsigned bits = static_cast<unsigned>(_mm256_movemask_pd(_mm256_castsi256_pd(m)));
+        if (count - i < 4)
+            bits &= (1u << (count - i)) - 1;
+        result += std::popcount(bits);
+        if (bits != 0xF)
+            break;
+    }
+    return result;
+}
+
+#elif defined(__SSE2__)
+
+inline size_t count_better(const double* prices, size_t count, double price, bool is_bid)
+{
+    const __m128d target = _mm_set1_pd(price);
+    size_t result = 0;
+    for (size_t i = 0; i < count; i += 2) {
+        const __m128d v = _mm_loadu_pd(prices + i);
+        const __m128d m = is_bid ? _mm_cmpgt_pd(v, target) : _mm_cmplt_pd(v, target);
+        unsigned bits = static_cast<unsigned>(_mm_movemask_pd(m));
+        if (count - i < 2)
+            bits &= 1u;
+        result += std::popcount(bits);
+        if (bits != 0x3)
+            break;
+    }
+    return result;
+}
+
+#if defined(__SSE4_2__)
+
+// 64-bit integer compares need SSE4.2, plain SSE2 builds use the scalar version for fixed-point prices
+inline size_t count_better(const int64_t* prices, size_t count, int64_t price, bool is_bid)
+{
+    const __m128i target = _mm_set1_epi64x(price);
+    size_t result = 0;
+    for (size_t i = 0; i < count; i += 2) {
+        const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(prices + i));
+        const __m128i m = is_bid ? _mm_cmpgt_epi64(v, target) : _mm_cmpgt_epi64(target, v);
+        unsigned bits = static_cast<unsigned>(_mm_movemask_pd(_mm_castsi128_pd(m)));
+        if (count - i < 2)
+            bits &= 1u;
+        result += std::popcount(bits);
+        if (bits != 0x3)
+            break;
+    }
+    return result;
+}
+
+#endif
+
+#endif
@@ -0,0 +1,102 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#include <immintrin.h>
+#endif
+
+// Tell the core we're spinning, so a busy-poll loop doesn't starve its hyperthread sibling
+inline void cpu_relax()
+{
+#if defined(__x86_64__) || defined(_M_X64)
+    _mm_pause();
+#endif
+}
+
+/*
+Lock-free single-producer single-consumer ring of Capacity slots.
+
+Slots are written and read in place (claim/publish on the producer side, front/pop on the consumer side) so a large
+element, like a whole depth snapshot, is never copied through a temporary. The producer and consumer indices live
+on separate cache lines, and each side keeps a cached copy of the other's index so it only touches the shared line
+when the ring looks full/empty.
+
+Consumers that don't want to spin can wait(), producers that call notify() after publishing will wake them.
+*/
+template <typename T, size_t Capacity>
+class SpscQueue
+{
+    static_assert(std::has_single_bit(Capacity), "Capacity must be a power of two");
+
+public:
+    // Producer: the next free slot, or nullptr if the ring is full
+    T* claim()
+    {
+        const size_t t = tail.load(std::memory_order_relaxed);
+        if (t - cached_head == Capacity) {
+            cached_head = head.load(std::memory_order_acquire);
+            if (t - cached_head == Capacity)
+                return nullptr;
+        }
+        return &slots[t & mask];
+    }
+
+    // Producer: make the claimed slot visible to the consumer
+    void publish() { tail.store(tail.load(std::memory_order_relaxed) + 1, std::memory_order_release); }
+
+    // Producer: wake a consumer blocked in wait()
+    void notify()
+    {
+        wakeups.fetch_add(1, std::memory_order_seq_cst);
+        wakeups.notify_one();
+    }
+
+    // Consumer: the oldest published slot, or nullptr if the ring is empty
+    T* front()
+    {
+        const size_t h = head.load(std::memory_order_relaxed);
+        if (h == cached_tail) {
+            cached_tail = tail.load(std::memory_order_acquire);
+            if (h == cached_tail)
+                return nullptr;
+        }
+        return &slots[h & mask];
+    }
+
+    // Consumer: release the slot returned by front()
+    void pop() { head.store(head.load(std::memory_order_relaxed) + 1, std::memory_order_release); }
+
+    /*
+    Consumer: block until something is published or notify() is called.
+    Take the ticket before checking whatever condition you're about to sleep on (e.g. a stop flag), then a notify()
+    that happens after that check can't be missed: it changes the count away from the ticket, so wait() returns.
+    */
+    uint32_t wait_ticket() const { return wakeups.load(std::memory_order_seq_cst); }
+
+    void wait(uint32_t ticket)
+    {
+        if (tail.load(std::memory_order_seq_cst) != head.load(std::memory_order_relaxed))
+            return;
+        wakeups.wait(ticket, std::memory_order_seq_cst);
+    }
+
+    bool empty() const { return tail.load(std::memory_order_acquire) == head.load(std::memory_order_acquire); }
+
+private:
+    static constexpr size_t mask = Capacity - 1;
+
+    alignas(64) std::atomic<size_t> head{ 0 }; // Next slot to read, written by the consumer
+    size_t cached_tail = 0;                    // Consumer's copy of tail
+
+    alignas(64) std::atomic<size_t> tail{ 0 }; // Next slot to write, written by the producer
+    size_t cached_head = 0;                    // Producer's copy of head
+
+    alignas(64) std::atomic<uint32_t> wakeups{ 0 };
+
+    alignas(64) std::array<T, Capacity> slots{};
+};
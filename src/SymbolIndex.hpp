@@ -0,0 +1,110 @@
+#pragma once
+
+#include <algorithm>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <string_view>
+
+/*
+Fixed-capacity map from a symbol ("BTCUSDT") to a small integer, used to route messages to books.
+
+Lookup is on the path of every bookTicker message, so it's built for that:
+ - Symbols are stored inline, zero padded to 24 bytes, so comparing one is three word compares and never
+   chases a pointer. Binance symbols are at most 20 characters.
+ - Entries are 32 bytes, two per cache line, and the table is kept at most half full with linear probing, so a
+   lookup is nearly always a single cache line.
+The table is allocated once in the constructor, inserting never allocates.
+*/
+class SymbolIndex
+{
+public:
+    static constexpr size_t max_symbol_length = 23;
+    static constexpr uint32_t npos = UINT32_MAX;
+
+    explicit SymbolIndex(size_t capacity)
+        : max_size(capacity),
+          mask(std::bit_ceil(std::max<size_t>(capacity * 2, 2)) - 1),
+          table(std::make_unique<Entry[]>(mask + 1))
+    {
+    }
+
+    size_t size() const { return count; }
+    size_t capacity() const { return max_size; }
+
+    // The value for symbol, or npos
+    uint32_t find(std::string_view symbol) const
+    {
+        Key key;
+        if (!make_key(symbol, key))
+            return npos;
+        const Entry& entry = probe(key);
+        return entry.length != 0 ? entry.value : npos;
+    }
+
+    // Fails if the symbol is already present, too long, or the index is full
+    bool insert(std::string_view symbol, uint32_t value)
+    {
+        Key key;
+        if (count == max_size || !make_key(symbol, key))
+            return false;
+        Entry& entry = probe(key);
+        if (entry.length != 0)
+            return false;
+        std::memcpy(entry.symbol, key.chars, sizeof(key.chars));
+        entry.length = static_cast<uint8_t>(symbol.size());
+        entry.value = value;
+        ++count;
+        return true;
+    }
+
+private:
+    struct Key
+    {
+        char chars[24]{};
+    };
+
+    struct alignas(32) Entry
+    {
+        char symbol[24]{};
+        uint8_t length = 0; // 0 marks an empty entry
+        uint32_t value = 0;
+    };
+
+    static bool make_key(std::string_view symbol, Key& key)
+    {
+        if (symbol.empty() || symbol.size() > max_symbol_length)
+            return false;
+        std::memcpy(key.chars, symbol.data(), symbol.size());
+        return true;
+    }
+
+    // Mix the three words of the padded symbol, multiply-xorshift is plenty for short upper case strings
+    static uint64_t hash(const Key& key)
+    {
+        uint64_t words[3];
+        std::memcpy(words, key.chars, sizeof(words));
+        uint64_t h = words[0] * 0x9E3779B97F4A7C15ull;
+        h = (h ^ (h >> 29) ^ words[1]) * 0xBF58476D1CE4E5B9ull;
+        h = (h ^ (h >> 32) ^ words[2]) * 0x94D049BB133111EBull;
+        return h ^ (h >> 31);
+    }
+
+    // The entry holding key, or the empty entry where it would go. The table is never more than half full,
+    // so there is always an empty entry to stop at.
+    Entry& probe(const Key& key) const
+    {
+        for (size_t i = hash(key) & mask;; i = (i + 1) & mask) {
+            Entry& entry = table[i];
+            if (entry.length == 0 || std::memcmp(entry.symbol, key.chars, sizeof(key.chars)) == 0)
+                return entry;
+        }
+    }
+
+    size_t max_size;
+    size_t mask;
+    std::unique_ptr<Entry[]> table;
+    size_t count = 0;
+};
@@ -1,12 +1,64 @@
 #pragma once
 
+#include <algorithm>
+#include <array>
 #include <cassert>
+#include <filesystem>
 #include <iostream>
+#include <map>
+#include <memory>
+#include <random>
+#include <thread>
+#include <ranges>
+#include <span>
+#include <tuple>
 
 #include "BinanceBook.hpp"
+#include "BinanceParser.hpp"
+#include "BookCheckpoint.hpp"
+#include "BookHistory.hpp"
+#include "BookRegistry.hpp"
+#include "CaptureReplay.hpp"
+#include "ConsolidatedBook.hpp"
+#include "SeqlockBook.hpp"
+#include "ShardedEngine.hpp"
 
 // Assuming PriceQuantity, format_double, and BinanceBook classes are defined as per the provided implementation.
 
+// Keeps everything a book reports, for the listener tests
+struct RecordingListener : BookListener<RecordingListener>
+{
+    std::vector<std::pair<std::optional<PriceQuantity>, std::optional<PriceQuantity>>> tops;
+    std::vector<std::pair<bool, PriceQuantity>> removed;
+    std::vector<std::tuple<bool, PriceQuantity, size_t>> uncrosses;
+
+    void on_bbo_change(const std::optional<PriceQuantity>& best_bid, const std::optional<PriceQuantity>& best_ask)
+    {
+        tops.emplace_back(best_bid, best_ask);
+    }
+    void on_level_removed(bool is_bid, const PriceQuantity& level) { removed.emplace_back(is_bid, level); }
+    void on_uncross(bool is_bid, const PriceQuantity& crossing, size_t count) { uncrosses.emplace_back(is_bid, crossing, count); }
+};
+
+// Only wants the top, the other callbacks fall back to the base's
+struct TopListener : BookListener<TopListener>
+{
+    size_t changes = 0;
+    void on_bbo_change(const std::optional<FixedPointPricing::Level>&, const std::optional<FixedPointPricing::Level>&) { ++changes; }
+};
+
+// Traits spelled out by hand rather than through BookTraits, for test_book_traits
+struct TickTraits
+{
+    static constexpr size_t depth = 10;
+    using PricingPolicy = FixedPointPricing;
+    using Level = FixedPointPricing::Level;
+    using Price = decltype(Level::price);
+    using SideStorage = SoaSide<Level, depth>;
+    using ListenerPolicy = NullListener;
+    using UncrossPolicy = KeepCrossed;
+};
+
 class Tests {
 public:
 
@@ -541,6 +593,1575 @@ public:
         std::cout << "Test book overflow handling passed.\n";
     }
 
+    static void test_depth_follows_template_n()
+    {
+        BinanceBook<5> book;
+
+        std::vector<PriceQuantity> bids;
+        std::vector<PriceQuantity> asks;
+        for (int i = 0; i < 8; ++i) {
+            bids.push_back({ 100.0 - i, 0.5 });
+            asks.push_back({ 101.0 + i, 0.5 });
+        }
+
+        // Snapshots deeper than the book are cut to depth n
+        book.replace(bids, asks);
+        auto [extracted_bids, extracted_asks] = book.extract();
+        assert(extracted_bids == std::vector<PriceQuantity>(bids.begin(), bids.begin() + 5));
+        assert(extracted_asks == std::vector<PriceQuantity>(asks.begin(), asks.begin() + 5));
+
+        // A new best pushes the worst level out
+        book.update_bbo({ 100.5, 0.1 }, { 100.7, 0.2 });
+
+        std::vector<PriceQuantity> expected_bids = { {100.5, 0.1}, {100, 0.5}, {99, 0.5}, {98, 0.5}, {97, 0.5} };
+        std::vector<PriceQuantity> expected_asks = { {100.7, 0.2}, {101, 0.5}, {102, 0.5}, {103, 0.5}, {104, 0.5} };
+
+        std::tie(extracted_bids, extracted_asks) = book.extract();
+        assert(extracted_bids == expected_bids);
+        assert(extracted_asks == expected_asks);
+
+        std::cout << "Test depth follows template n passed.\n";
+    }
+
+    static void test_ring_wraparound()
+    {
+        BinanceBook<4> book;
+
+        book.replace({ {10, 1}, {9, 1}, {8, 1}, {7, 1} }, { {11, 1}, {12, 1} });
+
+        // Walk the bid up and back down repeatedly so the ring head wraps in both directions
+        for (int round = 0; round < 10; ++round) {
+            book.new_best_bid({ 10.5, 2 });
+            book.new_best_bid({ 10.25, 3 });
+        }
+        // Once 10.25 is in the book each round pushes 10.5 on top (trimming the worst level at depth 4)
+        // and then drops it again, leaving 10.25 as a quantity update
+        std::vector<PriceQuantity> expected_bids = { {10.25, 3}, {10, 1}, {9, 1} };
+
+        auto [extracted_bids, extracted_asks] = book.extract();
+        assert(extracted_bids == expected_bids);
+
+        // An ask below every bid uncrosses the whole bid side
+        book.new_best_ask({ 5, 1 });
+        std::tie(extracted_bids, extracted_asks) = book.extract();
+        assert(extracted_bids.empty());
+        assert((extracted_asks == std::vector<PriceQuantity>{ {5, 1}, {11, 1}, {12, 1} }));
+
+        book.clear();
+        assert(book.is_empty());
+
+        std::cout << "Test ring wraparound passed.\n";
+    }
+
+    // Drive a ring book and an SoA book with the same random stream of snapshots and BBOs, they must always agree
+    template <size_t n>
+    static void test_soa_matches_ring()
+    {
+        BinanceBook<n, RingSide> ring;
+        BinanceBook<n, SoaSide> soa;
+
+        std::mt19937 rng(42);
+        std::uniform_int_distribution<int> tick(-30, 30);
+        std::uniform_int_distribution<int> lots(1, 100);
+
+        for (int i = 0; i < 20000; ++i) {
+            if (i % 500 == 0) {
+                std::vector<PriceQuantity> bids, asks;
+                for (size_t l = 0; l < n + 2; ++l) {
+                    bids.push_back({ 1000.0 - static_cast<double>(l), lots(rng) * 0.01 });
+                    asks.push_back({ 1001.0 + static_cast<double>(l), lots(rng) * 0.01 });
+                }
+                ring.replace(bids, asks);
+                soa.replace(bids, asks);
+            }
+
+            const PriceQuantity bid{ 1000.0 + tick(rng) * 0.5, lots(rng) * 0.01 };
+            const PriceQuantity ask{ 1001.0 + tick(rng) * 0.5, lots(rng) * 0.01 };
+            ring.update_bbo(bid, ask);
+            soa.update_bbo(bid, ask);
+
+            assert(ring.extract() == soa.extract());
+        }
+
+        std::cout << "Test SoA storage matches ring storage (depth " << n << ") passed.\n";
+    }
+
+    // Same random stream as above, but a fixed-point book against the floating-point one
+    template <template <typename, size_t> class Storage>
+    static void test_fixed_point_matches_floating_point()
+    {
+        BinanceBook<20> reference;
+        BinanceBook<20, Storage, FixedPointPricing> fixed(FixedPointPricing{ 2, 5 });
+
+        std::mt19937 rng(7);
+        std::uniform_int_distribution<int> tick(-30, 30);
+        std::uniform_int_distribution<int> lots(1, 100000);
+
+        for (int i = 0; i < 20000; ++i) {
+            if (i % 500 == 0) {
+                std::vector<PriceQuantity> bids, asks;
+                for (int l = 0; l < 20; ++l) {
+                    bids.push_back({ (2007854 - l) / 100.0, lots(rng) / 100000.0 });
+                    asks.push_back({ (2007891 + l) / 100.0, lots(rng) / 100000.0 });
+                }
+                reference.replace(bids, asks);
+                fixed.replace(bids, asks);
+            }
+
+            // Built the way a parser would produce them, so the floating-point book sees identical doubles for the
+            // same decimal price and both books agree on level identity
+            const PriceQuantity bid{ (2007854 + tick(rng)) / 100.0, lots(rng) / 100000.0 };
+            const PriceQuantity ask{ (2007891 + tick(rng)) / 100.0, lots(rng) / 100000.0 };
+            reference.update_bbo(bid, ask);
+            fixed.update_bbo(bid, ask);
+
+            assert(reference.extract() == fixed.extract());
+        }
+
+        std::cout << "Test fixed-point pricing matches floating-point pricing passed.\n";
+    }
+
+    static void test_fixed_point_exact_levels()
+    {
+        BinanceBook<20, RingSide, FixedPointPricing> book(FixedPointPricing{ 2, 8 });
+
+        // 0.1 + 0.2 != 0.3 as doubles, but both are the same 30 tick level
+        book.replace({ {0.3, 1}, {0.2, 1} }, { {0.5, 1} });
+        book.new_best_bid({ 0.1 + 0.2, 2 });
+
+        auto [extracted_bids, extracted_asks] = book.extract();
+        assert((extracted_bids == std::vector<PriceQuantity>{ {0.3, 2}, {0.2, 1} }));
+
+        // Converting back gives exactly the double the decimal string parses to
+        assert(extracted_bids[0].price == 0.3);
+
+        // Levels can also be given directly in ticks
+        book.update_bbo(FixedPointPricing::Level{ 31, 100000000 }, FixedPointPricing::Level{ 45, 300000000 });
+        std::tie(extracted_bids, extracted_asks) = book.extract();
+        assert((extracted_bids == std::vector<PriceQuantity>{ {0.31, 1}, {0.3, 2}, {0.2, 1} }));
+        assert((extracted_asks == std::vector<PriceQuantity>{ {0.45, 3}, {0.5, 1} }));
+
+        std::cout << "Test fixed-point exact levels passed.\n";
+    }
+
+    static void test_views()
+    {
+        BinanceBook<20, SoaSide> book;
+
+        assert(!book.best_bid() && !book.best_ask());
+        assert(book.depth() == std::make_pair(size_t{ 0 }, size_t{ 0 }));
+
+        std::vector<PriceQuantity> bids = { {5, 0.5}, {4, 0.4}, {3, 0.3} };
+        std::vector<PriceQuantity> asks = { {6, 0.6}, {7, 0.7} };
+        book.replace(bids, asks);
+
+        assert(*book.best_bid() == (PriceQuantity{ 5, 0.5 }));
+        assert(*book.best_ask() == (PriceQuantity{ 6, 0.6 }));
+        assert(book.depth() == std::make_pair(size_t{ 3 }, size_t{ 2 }));
+
+        const auto bid_view = book.bid_view();
+        static_assert(std::ranges::random_access_range<decltype(bid_view)>);
+        assert(std::ranges::equal(bid_view, bids));
+        assert(std::ranges::equal(book.ask_view(), asks));
+        assert(bid_view[2] == (PriceQuantity{ 3, 0.3 }));
+
+        // Caller-owned buffers, only as many levels as fit are written
+        std::array<PriceQuantity, 2> out_bids{};
+        std::array<PriceQuantity, 4> out_asks{};
+        const auto [bid_count, ask_count] = book.extract_into(out_bids, out_asks);
+        assert(bid_count == 2 && ask_count == 2);
+        assert(out_bids[1] == (PriceQuantity{ 4, 0.4 }));
+        assert(out_asks[1] == (PriceQuantity{ 7, 0.7 }));
+
+        std::cout << "Test views passed.\n";
+    }
+
+    static void test_replace_generic_ranges()
+    {
+        BinanceBook<3> book;
+        const std::vector<PriceQuantity> expected_bids = { {5, 0.5}, {4, 0.4}, {3, 0.3} };
+        const std::vector<PriceQuantity> expected_asks = { {6, 0.6}, {7, 0.7} };
+
+        // std::array, e.g. a parser's stack buffer
+        const std::array<PriceQuantity, 3> array_bids = { { {5, 0.5}, {4, 0.4}, {3, 0.3} } };
+        book.replace(array_bids, std::span(expected_asks));
+        assert(book.extract() == std::make_pair(expected_bids, expected_asks));
+
+        // (price, quantity) tuple-likes, and an rvalue vector
+        const std::vector<std::pair<double, double>> pair_bids = { {5, 0.5}, {4, 0.4}, {3, 0.3}, {2, 0.2} };
+        book.clear();
+        book.replace(pair_bids, std::vector<std::array<double, 2>>{ {6, 0.6}, {7, 0.7} });
+        assert(book.extract() == std::make_pair(expected_bids, expected_asks));
+
+        const std::tuple<double, double> tuple_asks[] = { {6, 0.6}, {7, 0.7} };
+        book.replace(std::vector<PriceQuantity>(expected_bids), tuple_asks);
+        assert(book.extract() == std::make_pair(expected_bids, expected_asks));
+
+        // A lazily generated, non-common input range: only the first n levels are read
+        auto generated = std::views::iota(0) | std::views::transform([](int i) { return PriceQuantity{ 5.0 - i, (5.0 - i) / 10 }; });
+        book.replace(generated, expected_asks);
+        assert(book.extract() == std::make_pair(expected_bids, expected_asks));
+
+        // Levels already in the book's own representation
+        BinanceBook<3, RingSide, FixedPointPricing> fixed(FixedPointPricing{ 0, 1 });
+        const std::vector<FixedPointPricing::Level> tick_bids = { {5, 5}, {4, 4}, {3, 3} };
+        fixed.replace(tick_bids, { {6, 0.6}, {7, 0.7} });
+        assert(fixed.extract() == std::make_pair(expected_bids, expected_asks));
+
+        std::cout << "Test replace with generic ranges passed.\n";
+    }
+
+    static void test_parse_depth_and_ticker()
+    {
+        // The example messages from BinanceBook.hpp, cut down to 3 levels per side
+        const std::string_view depth = R"({"lastUpdateId":34698491742,"bids":[["20078.54000000","0.00431000"],)"
+            R"(["20078.39000000","0.00100000"],["20078.27000000","0.00070000"]],)"
+            R"("asks":[["20078.91000000","0.03437000"],["20078.95000000","0.00100000"],["20078.99000000","0.00498000"]]})";
+        const std::string_view ticker =
+            R"({"u":34698491814,"s":"BTCUSDT","b":"20078.54000000","B":"0.00431000","a":"20078.91000000","A":"0.03497000"})";
+
+        const std::vector<PriceQuantity> expected_bids = { {20078.54, 0.00431}, {20078.39, 0.001}, {20078.27, 0.0007} };
+        std::vector<PriceQuantity> expected_asks = { {20078.91, 0.03437}, {20078.95, 0.001}, {20078.99, 0.00498} };
+
+        BinanceBook<20> book;
+        BinanceBook<20, SoaSide, FixedPointPricing> fixed(FixedPointPricing{ 2, 5 });
+
+        ParseReport report = handle_message(depth, book);
+        assert(report.ok && report.type == MessageType::Depth && report.update_id == 34698491742);
+        report = handle_message(depth, fixed);
+        assert(report.ok);
+
+        // Parsed values are bit-for-bit what the compiler (ie strtod) makes of the same decimal strings
+        auto [bids, asks] = book.extract();
+        assert(bids.size() == 3 && bids[0].price == 20078.54 && bids[2].quantity == 0.0007);
+        assert(book.extract() == std::make_pair(expected_bids, expected_asks));
+        assert(fixed.extract() == std::make_pair(expected_bids, expected_asks));
+
+        report = handle_message(ticker, book);
+        assert(report.ok && report.applied && report.type == MessageType::BookTicker && report.symbol == "BTCUSDT");
+        report = handle_message(ticker, fixed);
+        assert(report.ok);
+
+        expected_asks[0].quantity = 0.03497;
+        assert(book.extract() == std::make_pair(expected_bids, expected_asks));
+        assert(fixed.extract() == std::make_pair(expected_bids, expected_asks));
+
+        // Replaying the same ticker parses fine but is dropped by the book
+        report = handle_message(ticker, book);
+        assert(report.ok && !report.applied && book.sequence_stats().out_of_order == 1);
+
+        // Deep books parse snapshots as raw slices instead of a DepthMessage on the stack, with the same result
+        static_assert(sizeof(DepthMessage<300>) > max_stack_depth_message);
+        BinanceBook<300> deep;
+        report = handle_message(depth, deep);
+        assert(report.ok && report.applied && report.update_id == 34698491742);
+        report = handle_message(depth.substr(0, depth.size() / 2), deep);
+        assert(!report.ok);
+        RawDepthMessage raw;
+        const bool parsed_raw = parse_depth(depth, raw);
+        assert(parsed_raw && raw.bids.starts_with("[[") && raw.asks.ends_with("]]"));
+        expected_asks[0].quantity = 0.03437;
+        assert(deep.extract() == std::make_pair(expected_bids, expected_asks));
+        expected_asks[0].quantity = 0.03497;
+
+        // Only the book's depth is kept from a deeper snapshot, and unknown keys are skipped
+        DepthMessage<2> small;
+        const bool parsed_small = parse_depth(depth, small);
+        assert(parsed_small && small.bid_count == 2 && small.ask_count == 2);
+        TickerMessage message;
+        const bool parsed_ticker = parse_book_ticker(R"({"e":"bookTicker","u":7,"s":"ETHUSDT","b":"1.5","B":"2","a":"1.6","A":"3","T":[1,{"x":"]"}]})", message);
+        assert(parsed_ticker);
+        assert(message.update_id == 7 && message.symbol == "ETHUSDT" && message.ask.price.digits == 16 && message.ask.price.decimals == 1);
+
+        // Malformed or truncated input is reported, not applied
+        report = handle_message(depth.substr(0, depth.size() / 2), book);
+        assert(!report.ok);
+        report = handle_message(R"({"u":1,"b":"1.2.3"})", book);
+        assert(!report.ok);
+        report = handle_message("[]", book);
+        assert(report.type == MessageType::Unknown);
+        assert(book.extract() == std::make_pair(expected_bids, expected_asks));
+
+        std::cout << "Test parse depth and ticker passed.\n";
+    }
+
+    static void test_book_registry()
+    {
+        using Book = BinanceBook<20, RingSide, FixedPointPricing>;
+        BookRegistry<Book> registry(1000);
+
+        // Symbols get their own tick/lot sizes
+        Book* btc = registry.add("BTCUSDT", FixedPointPricing{ 2, 5 });
+        Book* eth = registry.add("ETHUSDT", FixedPointPricing{ 2, 4 });
+        assert(btc != nullptr && eth != nullptr && btc != eth);
+        Book* const again = registry.add("BTCUSDT");
+        Book* const too_long = registry.add("A_SYMBOL_LONGER_THAN_ANY_REAL_ONE");
+        assert(again == btc && too_long == nullptr);
+
+        // Fill it up to check probing holds up with many similar keys
+        for (int i = 0; registry.size() < registry.capacity(); ++i) {
+            Book* const added = registry.add("SYM" + std::to_string(i) + "USDT");
+            assert(added != nullptr);
+        }
+        Book* const one_more = registry.add("ONEMORE");
+        assert(one_more == nullptr);
+        for (int i = 0; i < 998; ++i)
+            assert(registry.find("SYM" + std::to_string(i) + "USDT") == &registry.at(i + 2));
+        assert(registry.find("BTCUSDT") == btc && registry.find("ETHUSDT") == eth);
+        assert(registry.find("BTCUSD") == nullptr && registry.find("") == nullptr);
+
+        // Slots are contiguous and don't share cache lines
+        assert(reinterpret_cast<uintptr_t>(btc) % 64 == 0);
+        assert(reinterpret_cast<const char*>(eth) - reinterpret_cast<const char*>(btc) >= 64);
+
+        // Dispatch by symbol
+        const ParseReport depth_report = registry.on_depth("ETHUSDT", R"({"lastUpdateId":5,"bids":[["1800.10","2.5"]],"asks":[["1800.20","1.25"]]})");
+        const ParseReport ticker_report = registry.on_book_ticker(R"({"u":6,"s":"ETHUSDT","b":"1800.15","B":"1","a":"1800.20","A":"2"})");
+        const ParseReport unknown_report = registry.on_book_ticker(R"({"u":7,"s":"XRPUSDT","b":"0.5","B":"1","a":"0.6","A":"2"})");
+        assert(depth_report.ok && ticker_report.ok && !unknown_report.ok);
+        assert(registry.unknown_symbols() == 1);
+
+        assert(btc->is_empty());
+        assert((eth->extract() == std::make_pair(std::vector<PriceQuantity>{ {1800.15, 1}, {1800.1, 2.5} }, std::vector<PriceQuantity>{ {1800.2, 2} })));
+
+        std::cout << "Test book registry passed.\n";
+    }
+
+    static void test_book_arena()
+    {
+        BookArena arena(4 << 20);
+        assert(arena.capacity() == 4 << 20 && arena.used() == 0);
+        const auto* words = arena.allocate_array<uint64_t>(3);
+        const void* aligned = arena.allocate(1, 64);
+        assert(words != nullptr && reinterpret_cast<uintptr_t>(aligned) % 64 == 0 && aligned > words && arena.owns(aligned));
+        assert(words[0] == 0 && arena.used() > 3 * sizeof(uint64_t));
+        const void* too_big = arena.allocate(arena.capacity(), 1);
+        assert(too_big == nullptr);
+
+        // Explicit huge pages if the machine has some reserved, normal pages otherwise; rounded up either way
+        BookArena huge(1, ArenaOptions{ /*huge_pages=*/true, /*prefault=*/true });
+        const void* on_huge = huge.allocate(4096, 64);
+        assert(huge.capacity() == BookArena::huge_page_size && on_huge != nullptr);
+
+        using Book = BinanceBook<20, RingSide, FixedPointPricing>;
+        BookRegistry<Book> registry(100, arena, /*with_scratch=*/true);
+        assert(registry.in_arena() && registry.has_scratch());
+        Book* btc = registry.add("BTCUSDT", FixedPointPricing{ 2, 5 });
+        Book* eth = registry.add("ETHUSDT", FixedPointPricing{ 2, 4 });
+        assert(arena.owns(btc) && arena.owns(eth) && arena.owns(&registry.scratch(99)));
+        assert(reinterpret_cast<uintptr_t>(btc) % 64 == 0 && reinterpret_cast<const char*>(eth) - reinterpret_cast<const char*>(btc) < 4096);
+
+        // The scratch area holds a replace()'s change set and the formatted book
+        auto& scratch = registry.scratch(0);
+        btc->replace({ {20078.54, 0.00431} }, { {20078.91, 0.03497} }, scratch.changes);
+        assert(scratch.changes.bid_count == 1 && scratch.changes.ask_count == 1);
+        const auto written = btc->format_to(scratch.text.data(), scratch.text.size());
+        assert(written && std::string_view(scratch.text.data(), *written) == btc->to_string());
+        const ParseReport report = registry.on_depth("ETHUSDT", R"({"lastUpdateId":5,"bids":[["1800.10","2.5"]],"asks":[["1800.20","1.25"]]})");
+        assert(report.ok);
+
+        // An arena that's too small leaves everything on the heap
+        BookArena tiny(4096);
+        BookRegistry<Book> fallback(100, tiny, /*with_scratch=*/true);
+        const Book* on_heap = fallback.add("ETHUSDT");
+        assert(!fallback.in_arena() && fallback.has_scratch() && on_heap != nullptr);
+        assert(!tiny.owns(&fallback.at(0)) && !tiny.owns(&fallback.scratch(0)));
+
+        std::cout << "Test book arena passed.\n";
+    }
+
+    static void test_sharded_engine(bool busy_poll)
+    {
+        using Book = BinanceBook<10, RingSide, FixedPointPricing>;
+
+        EngineOptions options;
+        options.shards = 3;
+        options.books_per_shard = 20;
+        options.busy_poll = busy_poll;
+        ShardedEngine<Book, 64> engine(options); // Small rings so the router has to wait on the shards sometimes
+        BookRegistry<Book> reference(60);
+
+        std::vector<std::string> symbols;
+        for (int i = 0; i < 50; ++i) {
+            symbols.push_back("SYM" + std::to_string(i));
+            const bool added = engine.add(symbols.back(), FixedPointPricing{ 2, 2 });
+            assert(added);
+            reference.add(symbols.back(), FixedPointPricing{ 2, 2 });
+        }
+        const bool added_twice = engine.add("SYM0");
+        const bool added_too_long = engine.add("A_SYMBOL_LONGER_THAN_ANY_REAL_ONE");
+        const bool added_empty = engine.add("");
+        assert(!added_twice && !added_too_long && !added_empty);
+        assert(engine.find("A_SYMBOL_LONGER_THAN_ANY_REAL_ONE") == nullptr && engine.find("") == nullptr);
+
+        std::mt19937 rng(3);
+        std::uniform_int_distribution<int> symbol(0, 49);
+        std::uniform_int_distribution<int> tick(-20, 20);
+
+        // Pre-generate so the messages outlive the router calls, like a network buffer would
+        std::vector<std::pair<std::string, std::string>> messages;
+        for (int i = 0; i < 20000; ++i) {
+            const std::string& s = symbols[symbol(rng)];
+            const std::string id = std::to_string(i + 1);
+            if (i % 100 == 0) {
+                messages.emplace_back(s, "{\"lastUpdateId\":" + id + R"(,"bids":[["99.00","1"],["98.00","2"]],"asks":[["101.00","1"],["102.00","2"]]})");
+            }
+            else {
+                messages.emplace_back("", "{\"u\":" + id + ",\"s\":\"" + s + "\",\"b\":\"" + format_double(99.5 + tick(rng) * 0.05, 2) +
+                    "\",\"B\":\"1.5\",\"a\":\"" + format_double(100.5 + tick(rng) * 0.05, 2) + "\",\"A\":\"2.5\"}");
+            }
+        }
+
+        engine.start();
+        for (const auto& [symbol, json] : messages) {
+            const bool routed = symbol.empty() ? engine.on_book_ticker(json) : engine.on_depth(symbol, json);
+            assert(routed);
+            if (symbol.empty())
+                reference.on_book_ticker(json);
+            else
+                reference.on_depth(symbol, json);
+        }
+        const bool routed_unknown = engine.on_book_ticker(R"({"u":1,"s":"NOPE","b":"1","B":"1","a":"2","A":"1"})");
+        assert(!routed_unknown);
+        engine.stop();
+
+        uint64_t processed = 0;
+        for (size_t i = 0; i < engine.shard_count(); ++i) {
+            assert(engine.processed(i) > 0);
+            processed += engine.processed(i);
+        }
+        assert(processed == messages.size());
+        for (const auto& s : symbols)
+            assert(engine.find(s)->extract() == reference.find(s)->extract());
+
+        // More shards or books than a route can address are refused up front
+        for (const auto& [shards, books] : { std::pair<size_t, size_t>{ 0, 20 }, { 1025, 1 }, { 1, size_t{ 1 } << 22 } }) {
+            EngineOptions bad;
+            bad.shards = shards;
+            bad.books_per_shard = books;
+            bool thrown = false;
+            try {
+                ShardedEngine<Book, 64> rejected(bad);
+            }
+            catch (const std::invalid_argument&) {
+                thrown = true;
+            }
+            assert(thrown);
+        }
+
+        std::cout << "Test sharded engine (" << (busy_poll ? "busy poll" : "blocking") << ") passed.\n";
+    }
+
+    // Every write leaves a book where all levels carry the write's number, so a torn snapshot would show mixed values
+    template <template <typename, size_t> class Storage>
+    static void test_seqlock_snapshots()
+    {
+        SeqlockBook<BinanceBook<20, Storage>> book;
+        constexpr int writes = 100000;
+
+        std::thread writer([&book] {
+            std::array<PriceQuantity, 20> bids{}, asks{};
+            for (int k = 1; k <= writes; ++k) {
+                // Alternate between two price grids and depths so both indices and contents change
+                const double offset = (k % 2) * 0.5;
+                const size_t depth = k % 2 ? 20 : 15;
+                for (size_t l = 0; l < 20; ++l) {
+                    bids[l] = { 100.0 - offset - static_cast<double>(l), static_cast<double>(k) };
+                    asks[l] = { 101.0 + offset + static_cast<double>(l), static_cast<double>(k) };
+                }
+                book.replace(std::span(bids.data(), depth), std::span(asks.data(), depth));
+                if (k % 3 == 0)
+                    book.update_bbo(PriceQuantity{ 100.25, static_cast<double>(k) }, PriceQuantity{ 100.75, static_cast<double>(k) });
+            }
+        });
+
+        std::array<PriceQuantity, 20> bids{}, asks{};
+        double last = 0;
+        int snapshots = 0;
+        while (last < writes) {
+            const auto [bid_count, ask_count] = book.snapshot(bids, asks);
+            if (bid_count == 0)
+                continue;
+            const double k = bids[0].quantity;
+            assert(bid_count == ask_count && (bid_count == 15 || bid_count == 16 || bid_count == 20));
+            for (size_t l = 0; l < bid_count; ++l)
+                assert(bids[l].quantity == k && asks[l].quantity == k);
+            assert(k >= last);
+            last = k;
+            ++snapshots;
+            std::this_thread::yield();
+        }
+        writer.join();
+
+        assert(snapshots > 0);
+        assert(book.version() == writes + writes / 3);
+        std::cout << "Test seqlock snapshots passed.\n";
+    }
+
+    static void test_update_id_sequencing()
+    {
+        BinanceBook<20> book;
+        const std::vector<PriceQuantity> bids = { {4, 1}, {3, 1}, {2, 1} };
+        const std::vector<PriceQuantity> asks = { {6, 1}, {7, 1}, {8, 1} };
+
+        const bool snapshot = book.replace(100, bids, asks);
+        assert(snapshot);
+
+        // A ticker from before the snapshot would have uncrossed the bids at 4 and 3
+        const bool before_snapshot = book.update_bbo(99, { 1, 1 }, { 2.5, 1 });
+        assert(!before_snapshot);
+        assert(book.extract() == std::make_pair(bids, asks));
+
+        const bool newer = book.update_bbo(105, { 4, 2 }, { 6, 2 });
+        const bool overtaken = book.update_bbo(103, { 5, 1 }, { 5.5, 1 }); // Overtaken by 105
+        const bool duplicate = book.update_bbo(BookTicker{ 105, { 5, 1 }, { 5.5, 1 } });
+        const bool older_snapshot = book.replace(90, {}, {});
+        const bool behind_ticker = book.replace(104, {}, {}); // Newer than the snapshot, older than the last ticker
+        const bool newest = book.update_bbo(BookTicker{ 106, { 4.5, 1 }, { 6, 3 } });
+        assert(newer && !overtaken && !duplicate && !older_snapshot && !behind_ticker && newest);
+
+        assert(book.last_update_id() == 106 && book.snapshot_update_id() == 100);
+        const auto& stats = book.sequence_stats();
+        assert(stats.applied == 3 && stats.stale == 2 && stats.out_of_order == 3);
+
+        assert((book.extract() == std::make_pair(std::vector<PriceQuantity>{ {4.5, 1}, {4, 2}, {3, 1}, {2, 1} },
+                                                 std::vector<PriceQuantity>{ {6, 3}, {7, 1}, {8, 1} })));
+
+        // Unsequenced calls still apply unconditionally
+        book.update_bbo({ 1, 1 }, { 2, 1 });
+        assert(book.best_bid()->price == 1 && book.last_update_id() == 106);
+
+        std::cout << "Test update id sequencing passed.\n";
+    }
+
+    // Random bursts with lots of repeated prices, against the same tickers applied one at a time
+    template <template <typename, size_t> class Storage>
+    static void test_bbo_batches()
+    {
+        BinanceBook<20, Storage> one_by_one, exact, conflated;
+
+        std::mt19937 rng(11);
+        std::uniform_int_distribution<int> tick(-4, 4);
+        std::uniform_int_distribution<int> lots(1, 100);
+        std::uniform_int_distribution<int> burst(1, 40);
+
+        uint64_t id = 0;
+        size_t coalesced = 0;
+        std::vector<BookTicker> tickers;
+        for (int i = 0; i < 2000; ++i) {
+            if (i % 50 == 0) {
+                std::vector<PriceQuantity> bids, asks;
+                for (int l = 0; l < 20; ++l) {
+                    bids.push_back({ 1000.0 - l, lots(rng) * 0.01 });
+                    asks.push_back({ 1001.0 + l, lots(rng) * 0.01 });
+                }
+                ++id;
+                one_by_one.replace(id, bids, asks);
+                exact.replace(id, bids, asks);
+                conflated.replace(id, bids, asks);
+            }
+
+            tickers.clear();
+            const int count = burst(rng);
+            PriceQuantity bid{ 1000.0 + tick(rng) * 0.5, 1 }, ask{ 1001.0 + tick(rng) * 0.5, 1 };
+            for (int t = 0; t < count; ++t) {
+                if (lots(rng) <= 20) {
+                    bid.price = 1000.0 + tick(rng) * 0.5;
+                    ask.price = 1001.0 + tick(rng) * 0.5;
+                }
+                bid.quantity = lots(rng) * 0.01;
+                ask.quantity = lots(rng) * 0.01;
+                // Now and then one arrives late
+                const uint64_t ticker_id = lots(rng) <= 5 ? id - 1 : ++id;
+                tickers.push_back({ ticker_id, bid, ask });
+            }
+
+            for (const BookTicker& ticker : tickers)
+                one_by_one.update_bbo(ticker);
+            coalesced += exact.apply_bbo_batch(tickers);
+            conflated.apply_bbo_batch(tickers, BboBatchMode::Conflated);
+
+            assert(exact.extract() == one_by_one.extract());
+            // The top is the last applied ticker, unless it was crossed and its ask uncrossed its own bid
+            const auto last = std::ranges::find(tickers, one_by_one.last_update_id(), &BookTicker::update_id);
+            if (last != tickers.end() && last->bid.price < last->ask.price)
+                assert(conflated.best_bid() == one_by_one.best_bid() && conflated.best_ask() == one_by_one.best_ask());
+        }
+        assert(coalesced > 0);
+
+        const auto& stats = one_by_one.sequence_stats();
+        assert(exact.sequence_stats().applied == stats.applied && exact.sequence_stats().out_of_order == stats.out_of_order);
+        assert(conflated.sequence_stats().applied == stats.applied && conflated.last_update_id() == one_by_one.last_update_id());
+
+        // Everything but the last ticker is folded in conflated mode
+        BinanceBook<20, Storage> book;
+        const std::vector<BookTicker> burst_of_three = { {1, {10, 1}, {11, 1}}, {2, {9, 1}, {12, 1}}, {3, {8, 1}, {13, 1}} };
+        const size_t folded = book.apply_bbo_batch(burst_of_three, BboBatchMode::Conflated);
+        assert(folded == 2);
+        assert(book.extract() == std::make_pair(std::vector<PriceQuantity>{ {8, 1} }, std::vector<PriceQuantity>{ {13, 1} }));
+        const size_t folded_again = book.apply_bbo_batch(burst_of_three);
+        assert(folded_again == 0 && book.sequence_stats().stale == 0);
+
+        // The middle ticker's bid crosses the asks below 12.5, which the last one doesn't: conflating still takes
+        // them out, and ends up where applying every ticker does
+        const std::vector<BookTicker> through_the_asks = { {2, {10, 2}, {11, 2}}, {3, {12.5, 1}, {13, 1}}, {4, {10, 3}, {11.5, 3}} };
+        BinanceBook<20, Storage> each, conflated_deep;
+        for (auto* deep : { &each, &conflated_deep })
+            deep->replace(1, { {10, 1}, {9, 1}, {8, 1} }, { {11, 1}, {12, 1}, {13, 1}, {14, 1} });
+        for (const BookTicker& ticker : through_the_asks)
+            each.update_bbo(ticker);
+        const size_t folded_deep = conflated_deep.apply_bbo_batch(through_the_asks, BboBatchMode::Conflated);
+        assert(folded_deep == 2 && conflated_deep.extract() == each.extract());
+        assert(each.extract().second == (std::vector<PriceQuantity>{ {11.5, 3}, {13, 1}, {14, 1} }));
+
+        std::cout << "Test batched BBO updates passed.\n";
+    }
+
+    // Record a random stream for a few symbols, replay it from the file and compare with the books it was recorded from
+    static void test_capture_replay()
+    {
+        const std::string path = (std::filesystem::temp_directory_path() / "binancebook_capture_test.bin").string();
+        const std::vector<std::string> symbols = { "BTCUSDT", "ETHUSDT", "BNBUSDT" };
+
+        BookRegistry<BinanceBook<20>> recorded(symbols.size());
+        for (const std::string& symbol : symbols)
+            recorded.add(symbol);
+
+        std::mt19937 rng(5);
+        std::uniform_int_distribution<int> tick(-30, 30);
+        std::uniform_int_distribution<int> lots(1, 100);
+        {
+            CaptureWriter writer(path, 20);
+            assert(writer.ok());
+
+            // Deeper than the capture: only 20 levels are kept, same as the book does
+            DepthMessage<30> message;
+            std::string json = R"({"lastUpdateId":1,"bids":[)";
+            for (int l = 0; l < 30; ++l) {
+                json += l ? ",[\"" : "[\"";
+                json += std::to_string(1000 - l) + ".00\",\"1.5\"]";
+            }
+            json += R"(],"asks":[["1001.00","2"]]})";
+            const bool parsed = parse_depth(json, message);
+            assert(parsed);
+            for (const std::string& symbol : symbols) {
+                const bool written = writer.write_depth(symbol, 0, message);
+                assert(written);
+                apply_depth(message, *recorded.find(symbol));
+            }
+
+            uint64_t id = 1;
+            for (int i = 0; i < 3000; ++i) {
+                const std::string& symbol = symbols[static_cast<size_t>(i) % symbols.size()];
+                const int64_t timestamp = i * 1000;
+                if (i % 100 == 0) {
+                    std::vector<PriceQuantity> bids, asks;
+                    for (int l = 0; l < 25; ++l) {
+                        bids.push_back({ 1000.0 - l, lots(rng) * 0.01 });
+                        asks.push_back({ 1001.0 + l, lots(rng) * 0.01 });
+                    }
+                    const bool written = writer.write_depth(symbol, timestamp, ++id, bids, asks);
+                    assert(written);
+                    recorded.find(symbol)->replace(id, bids, asks);
+                }
+                else {
+                    // Every so often one older than the symbol's last update, which the books drop both times
+                    const BookTicker ticker{ i % 37 == 0 ? id - 3 : ++id, { 1000.0 + tick(rng) * 0.5, lots(rng) * 0.01 },
+                                             { 1001.0 + tick(rng) * 0.5, lots(rng) * 0.01 } };
+                    const bool written = writer.write_book_ticker(symbol, timestamp, ticker);
+                    assert(written);
+                    recorded.find(symbol)->update_bbo(ticker.update_id, ticker.bid, ticker.ask);
+                }
+            }
+            const bool unknown_symbol = writer.write_book_ticker("XRPUSDT", 3'000'000, BookTicker{ ++id, { 1, 1 }, { 2, 1 } });
+            const bool too_long = writer.write_book_ticker("ABCDEFGHIJKLMNOPQRSTUVWXYZ", 3'000'000, BookTicker{});
+            assert(unknown_symbol && !too_long);
+            assert(writer.records() == 3 + 3000 + 1);
+        }
+
+        BookRegistry<BinanceBook<20>> replayed(symbols.size());
+        for (const std::string& symbol : symbols)
+            replayed.add(symbol);
+
+        CaptureReader reader(path);
+        assert(reader.ok() && reader.depth() == 20);
+        const ReplayStats stats = replay(reader, replayed);
+        assert(stats.events == 3004 && stats.unknown_symbols == 1 && stats.latency.count() == 3003);
+
+        uint64_t applied = 0;
+        for (const std::string& symbol : symbols) {
+            assert(replayed.find(symbol)->extract() == recorded.find(symbol)->extract());
+            applied += recorded.find(symbol)->sequence_stats().applied;
+        }
+        assert(stats.applied == applied && applied < 3003);
+
+        // Paced by the timestamps (3ms of them), here at twice the recorded speed
+        reader.rewind();
+        BookRegistry<BinanceBook<20>> paced(symbols.size());
+        for (const std::string& symbol : symbols)
+            paced.add(symbol);
+        ReplayOptions options;
+        options.recorded_timing = true;
+        options.speed = 2;
+        const ReplayStats paced_stats = replay(reader, paced, options);
+        assert(paced_stats.events == 3004 && paced_stats.elapsed_ns >= 1'500'000);
+        assert(paced.find("ETHUSDT")->extract() == recorded.find("ETHUSDT")->extract());
+
+        // Not a capture
+        {
+            std::FILE* file = std::fopen(path.c_str(), "wb");
+            std::fputs("{\"u\":1}", file);
+            std::fclose(file);
+        }
+        CaptureReader not_a_capture(path);
+        const bool has_event = not_a_capture.next(*std::make_unique<CaptureEvent>());
+        assert(!not_a_capture.ok() && !has_event);
+        std::filesystem::remove(path);
+
+        std::cout << "Test capture and replay passed.\n";
+    }
+
+    static void test_book_counters()
+    {
+        static_assert(std::is_empty_v<NoBookCounters>);
+
+        BinanceBook<3> book;
+        book.replace({ {4, 1}, {3, 1}, {2, 1} }, { {6, 1}, {7, 1}, {8, 1} });
+        book.update_bbo({ 4, 2 }, { 6, 2 });     // Quantities only
+        book.update_bbo({ 5, 1 }, { 5.5, 1 });   // New tops at full depth, both trim a level
+        book.update_bbo({ 3.5, 1 }, { 6.5, 1 }); // Two levels dropped ahead of each
+        book.update_bbo({ 7, 1 }, { 8, 1 });     // The bid uncrosses 6.5, the ask drops 7
+        book.update_bbo({ 0, 1 }, { 9, 1 });     // Bid rejected
+
+        const BookCounterValues values = book.counter_values();
+        if constexpr (BinanceBook<3>::counters_enabled) {
+            assert(values.quantity_updates == 2 && values.inserts == 7 && values.trimmed == 2);
+            assert(values.prefix_dropped == 6 && values.uncrossed == 1 && values.rejected == 1);
+
+            const uint64_t samples = values.quantity_cycles.samples + values.insert_cycles.samples + values.uncross_cycles.samples;
+            if constexpr (BookCounters::sample_period == 1)
+                assert(values.quantity_cycles.samples == 2 && values.insert_cycles.samples == 6 && values.uncross_cycles.samples == 1);
+            assert(samples <= 9 && (BookCounters::sample_period != 0 || samples == 0));
+
+            BookCounterValues total = values;
+            total += values;
+            assert(total.inserts == 14 && total.rejected == 2);
+        }
+        else {
+            assert(values.inserts == 0 && values.rejected == 0);
+        }
+
+        std::cout << "Test book counters passed.\n";
+    }
+
+    // Random diff-depth updates against a full reference book. Prices stay apart so the reference is never crossed.
+    template <size_t n, template <typename, size_t> class Storage>
+    static void test_apply_delta_random()
+    {
+        BinanceBook<n, Storage> book;
+        std::map<double, double, std::greater<>> true_bids;
+        std::map<double, double> true_asks;
+
+        std::mt19937 rng(n);
+        std::uniform_int_distribution<int> tick(0, 29);
+        std::uniform_int_distribution<int> lots(0, 20);
+        std::uniform_int_distribution<int> levels(0, 6);
+
+        const auto extract_prefix = [](const auto& truth, size_t count) {
+            std::vector<PriceQuantity> prefix;
+            for (auto it = truth.begin(); it != truth.end() && prefix.size() < count; ++it)
+                prefix.push_back({ it->first, it->second });
+            return prefix;
+        };
+
+        for (int i = 0; i < 5000; ++i) {
+            if (i % 1000 == 0) {
+                book.replace(extract_prefix(true_bids, true_bids.size()), extract_prefix(true_asks, true_asks.size()));
+            }
+
+            std::vector<PriceQuantity> bids, asks;
+            for (int l = levels(rng); l > 0; --l)
+                bids.push_back({ 999.0 - tick(rng), lots(rng) * 0.5 });
+            for (int l = levels(rng); l > 0; --l)
+                asks.push_back({ 1001.0 + tick(rng), lots(rng) * 0.5 });
+            for (const auto& level : bids)
+                level.quantity == 0 ? void(true_bids.erase(level.price)) : void(true_bids[level.price] = level.quantity);
+            for (const auto& level : asks)
+                level.quantity == 0 ? void(true_asks.erase(level.price)) : void(true_asks[level.price] = level.quantity);
+            book.apply_delta(bids, asks);
+
+            // Always the best levels, in order, with nothing missing in between
+            const auto [book_bids, book_asks] = book.extract();
+            assert(book_bids.size() <= n && book_asks.size() <= n);
+            assert(book_bids == extract_prefix(true_bids, book_bids.size()));
+            assert(book_asks == extract_prefix(true_asks, book_asks.size()));
+            // Deep enough that nothing is ever cut off: the book is the whole reference
+            if (n > 30)
+                assert(book_bids.size() == true_bids.size() && book_asks.size() == true_asks.size());
+        }
+        std::cout << "Test apply_delta random<" << n << "> passed.\n";
+    }
+
+    static void test_apply_delta()
+    {
+        BinanceBook<4> book;
+        book.replace({ {10, 1}, {9, 1}, {8, 1}, {7, 1} }, { {11, 1}, {12, 1} });
+
+        // Update in place, delete in the middle, insert in the middle (pushing 7 out), delete unknown prices
+        book.apply_delta({ {9, 5}, {8, 0}, {9.5, 2}, {8.5, 3}, {1, 0} }, { {11.5, 2}, {13, 0} });
+        assert((book.extract() == std::make_pair(std::vector<PriceQuantity>{ {10, 1}, {9.5, 2}, {9, 5}, {8.5, 3} },
+                                                 std::vector<PriceQuantity>{ {11, 1}, {11.5, 2}, {12, 1} })));
+
+        // The snapshot filled the bids, so below 8.5 may be levels the book never saw: deleting doesn't invent them,
+        // and a level beyond what's held can't be appended
+        book.apply_delta({ {8.5, 0}, {7.5, 1} }, {});
+        assert(book.extract().first.size() == 3 && book.best_bid()->price == 10);
+        // The asks weren't full, so they're complete and grow at the back
+        book.apply_delta({}, { {14, 1} });
+        assert(book.extract().second.back().price == 14);
+
+        // A bid at an ask price removes that ask and everything better
+        book.apply_delta({ {11.5, 1} }, {});
+        assert(book.best_bid()->price == 11.5 && book.best_ask()->price == 12);
+        book.apply_delta({}, { {10, 7} });
+        assert(book.best_ask()->price == 10 && book.best_bid()->price == 9.5);
+        book.apply_delta({ {0, 1}, {-1, 1} }, {}); // Ignored
+        assert(book.best_bid()->price == 9.5);
+
+        // Sequencing: U..u must continue from the last applied id
+        BinanceBook<20> sequenced;
+        const bool snapshot = sequenced.replace(100, { {10, 1} }, { {11, 1} });
+        const DeltaResult covered = sequenced.apply_delta(95, 100, { {10, 9} }, {});
+        const DeltaResult straddles = sequenced.apply_delta(98, 102, { {10, 2} }, {}); // Straddles the snapshot
+        const DeltaResult follows = sequenced.apply_delta(103, 103, { {9, 1} }, {});
+        const DeltaResult skips = sequenced.apply_delta(105, 106, { {8, 1} }, {}); // 104 is missing
+        const DeltaResult still_missing = sequenced.apply_delta(107, 107, { {7, 1} }, {});
+        assert(snapshot && covered == DeltaResult::Stale && straddles == DeltaResult::Applied && follows == DeltaResult::Applied);
+        assert(skips == DeltaResult::Gap && still_missing == DeltaResult::Gap);
+        assert(sequenced.last_update_id() == 103 && sequenced.sequence_stats().gaps == 2);
+        assert((sequenced.extract().first == std::vector<PriceQuantity>{ {10, 2}, {9, 1} }));
+        const bool new_snapshot = sequenced.replace(110, { {10, 1} }, { {11, 1} });
+        const DeltaResult after_snapshot = sequenced.apply_delta(111, 111, {}, { {11, 0} });
+        assert(new_snapshot && after_snapshot == DeltaResult::Applied);
+        assert(sequenced.best_ask() == std::nullopt);
+
+        // A ticker in between doesn't move the diff sequence: the diff it overtook still has levels to apply
+        BinanceBook<20> interleaved;
+        interleaved.replace(100, { {10, 1}, {9, 1}, {8, 1} }, { {11, 1} });
+        const bool ticker_applied = interleaved.update_bbo(105, { 10, 2 }, { 11, 1 });
+        const DeltaResult overtaken = interleaved.apply_delta(101, 105, { {9, 0}, {7.5, 3} }, {});
+        assert(ticker_applied && overtaken == DeltaResult::Applied);
+        assert((interleaved.extract().first == std::vector<PriceQuantity>{ {10, 2}, {8, 1}, {7.5, 3} }));
+        assert(interleaved.last_update_id() == 105 && interleaved.diff_update_id() == 105);
+        const bool older_ticker = interleaved.update_bbo(104, { 12, 1 }, { 13, 1 });
+        assert(!older_ticker);
+
+        // A gap stays a gap whatever comes after it, until a snapshot
+        const DeltaResult missed = interleaved.apply_delta(107, 108, { {7, 1} }, {});
+        const bool ticker_after_gap = interleaved.update_bbo(110, { 10, 3 }, { 11, 1 });
+        const DeltaResult after_ticker = interleaved.apply_delta(111, 111, { {6, 1} }, {});
+        assert(missed == DeltaResult::Gap && ticker_after_gap && after_ticker == DeltaResult::Gap);
+        assert(interleaved.gap_pending() && interleaved.sequence_stats().gaps == 2);
+        assert((interleaved.extract().first == std::vector<PriceQuantity>{ {10, 3}, {8, 1}, {7.5, 3} }));
+        // The snapshot that repairs it only has to be newer than the diffs, not the ticker
+        const bool repaired = interleaved.replace(109, { {10, 1} }, { {11, 1} });
+        const DeltaResult resumed = interleaved.apply_delta(110, 111, { {6, 1} }, {});
+        assert(repaired && resumed == DeltaResult::Applied && !interleaved.gap_pending());
+        assert(interleaved.last_update_id() == 111 && interleaved.snapshot_update_id() == 109);
+
+        // Parsed from the stream
+        const std::string json = R"({"e":"depthUpdate","E":1,"s":"BNBBTC","U":112,"u":114,)"
+                                 R"("b":[["10.00000000","0.00000000"],["9.5","3"]],"a":[["11.1","2.5"],["12","1"]]})";
+        assert(detect_message_type(json) == MessageType::DepthUpdate);
+        assert(detect_message_type(R"({"e":"bookTicker","u":1})") == MessageType::BookTicker);
+        DepthUpdateMessage message;
+        const bool parsed = parse_depth_update(json, message);
+        assert(parsed && message.first_update_id == 112 && message.last_update_id == 114);
+        assert(message.symbol == "BNBBTC");
+        const ParseReport report = handle_message(json, sequenced);
+        assert(report.ok && report.applied && report.type == MessageType::DepthUpdate && report.update_id == 114);
+        assert((sequenced.extract() == std::make_pair(std::vector<PriceQuantity>{ {9.5, 3} },
+                                                      std::vector<PriceQuantity>{ {11.1, 2.5}, {12, 1} })));
+        const bool parsed_malformed = parse_depth_update(R"({"U":1,"u":2,"b":[["1","2"],["3"]],"a":[]})", message);
+        assert(!parsed_malformed);
+
+        BookRegistry<BinanceBook<20>> registry(4);
+        registry.add("BNBBTC")->replace(111, { {10, 1} }, { {11, 1} });
+        const ParseReport first = registry.on_depth_update(json);
+        assert(first.applied && registry.at(0).best_bid()->price == 9.5);
+        const ParseReport seen = registry.on_depth_update(json);
+        const ParseReport unknown = registry.on_depth_update(R"({"e":"depthUpdate","s":"ETHBTC","U":1,"u":1,"b":[],"a":[]})");
+        assert(!seen.applied && !unknown.ok);
+        assert(registry.unknown_symbols() == 1);
+
+        std::cout << "Test apply_delta passed.\n";
+    }
+
+    static void test_replace_change_set()
+    {
+        BinanceBook<5> book;
+        BinanceBook<5>::ChangeSet changes;
+        book.replace({ {10, 1}, {9, 1}, {8, 1} }, { {11, 1}, {12, 1} });
+
+        // Same book: nothing to report
+        book.replace({ {10, 1}, {9, 1}, {8, 1} }, { {11, 1}, {12, 1} }, changes);
+        assert(changes.empty() && !changes.top_changed());
+
+        // 9 changes quantity, 8 goes, 7 and 8.5 arrive; the asks only change below the top
+        book.replace({ {10, 1}, {9, 2}, {8.5, 1}, {7, 1} }, { {11, 1}, {12, 3} }, changes);
+        assert(!changes.top_changed() && changes.bids().size() == 4 && changes.asks().size() == 1);
+        const auto& b = changes.bids();
+        assert(b[0].kind == LevelChangeKind::QuantityChanged && b[0].index == 1 && b[0].level.quantity == 2 && b[0].previous_quantity == 1);
+        assert(b[1].kind == LevelChangeKind::Inserted && b[1].index == 2 && b[1].level.price == 8.5);
+        assert(b[2].kind == LevelChangeKind::Removed && b[2].index == 2 && b[2].level.price == 8);
+        assert(b[3].kind == LevelChangeKind::Inserted && b[3].index == 3 && b[3].level.price == 7);
+        assert(changes.asks()[0].kind == LevelChangeKind::QuantityChanged && changes.asks()[0].index == 1);
+
+        // New best ask, bids emptied
+        book.replace({}, { {10.5, 1}, {11, 1}, {12, 3} }, changes);
+        assert(changes.bid_top_changed && changes.ask_top_changed && changes.bids().size() == 4);
+        assert(std::ranges::all_of(changes.bids(), [](const auto& c) { return c.kind == LevelChangeKind::Removed; }));
+
+        // Stale snapshots report nothing
+        const bool sequenced = book.replace(10, { {1, 1} }, {}, changes);
+        assert(sequenced && changes.bid_top_changed);
+        const bool stale = book.replace(9, {}, {}, changes);
+        assert(!stale && changes.empty() && !changes.top_changed());
+
+        // Random snapshots: replaying the changes onto the previous book gives the new one
+        BinanceBook<20, SoaSide> random_book;
+        BinanceBook<20, SoaSide>::ChangeSet random_changes;
+        std::mt19937 rng(5);
+        std::uniform_int_distribution<int> coin(0, 3);
+        for (int i = 0; i < 2000; ++i) {
+            std::vector<PriceQuantity> bids, asks;
+            for (int l = 0; l < 30; ++l) {
+                if (coin(rng) != 0)
+                    bids.push_back({ 100.0 - l, static_cast<double>(coin(rng) + 1) });
+                if (coin(rng) != 0)
+                    asks.push_back({ 101.0 + l, static_cast<double>(coin(rng) + 1) });
+            }
+            auto [before_bids, before_asks] = random_book.extract();
+            random_book.replace(bids, asks, random_changes);
+
+            const auto replay = [](std::vector<PriceQuantity> side, std::span<const LevelChange<PriceQuantity>> changes) {
+                // Removals are indexed against the old side, so apply them first from the back
+                for (auto it = changes.rbegin(); it != changes.rend(); ++it)
+                    if (it->kind == LevelChangeKind::Removed)
+                        side.erase(side.begin() + it->index);
+                for (const auto& change : changes) {
+                    if (change.kind == LevelChangeKind::Inserted)
+                        side.insert(side.begin() + change.index, change.level);
+                    else if (change.kind == LevelChangeKind::QuantityChanged)
+                        side[change.index].quantity = change.level.quantity;
+                }
+                return side;
+            };
+            const auto [after_bids, after_asks] = random_book.extract();
+            assert(replay(before_bids, random_changes.bids()) == after_bids);
+            assert(replay(before_asks, random_changes.asks()) == after_asks);
+            const auto top = [](const std::vector<PriceQuantity>& side) { return side.empty() ? std::nullopt : std::optional(side[0]); };
+            assert(random_changes.bid_top_changed == (top(before_bids) != top(after_bids)));
+        }
+
+        std::cout << "Test replace change set passed.\n";
+    }
+
+    static void test_listener()
+    {
+        // Nothing to store for the default listener
+        static_assert(sizeof(BinanceBook<20>) == sizeof(BinanceBook<20, RingSide, FloatingPointPricing, NullListener>));
+
+        BinanceBook<3, RingSide, FloatingPointPricing, RecordingListener> book;
+        auto& events = book.listener_policy();
+        using Top = std::pair<std::optional<PriceQuantity>, std::optional<PriceQuantity>>;
+        using Removed = std::pair<bool, PriceQuantity>;
+
+        book.replace({ {10, 1}, {9, 1}, {8, 1} }, { {11, 1}, {12, 1}, {13, 1} });
+        assert(events.tops.size() == 1 && events.tops[0] == Top({ {10, 1} }, { {11, 1} }) && events.removed.empty());
+
+        // Quantity below the top: no top change
+        book.update_bbo({ 10, 1 }, { 11, 1 });
+        assert(events.tops.size() == 1);
+
+        // New best bid pushes 8 out; the ask at 10.5 is new too
+        book.update_bbo({ 10.2, 2 }, { 10.5, 1 });
+        assert(events.tops.size() == 2 && events.tops[1] == Top({ {10.2, 2} }, { {10.5, 1} }));
+        assert((events.removed == std::vector<Removed>{ { true, {8, 1} }, { false, {13, 1} } }));
+
+        // A bid through two asks: it pushes 9 out, the asks are reported removed, then the uncross
+        events.removed.clear();
+        book.update_bbo({ 11.5, 1 }, { 12, 4 });
+        assert((events.removed == std::vector<Removed>{ { true, {9, 1} }, { false, {10.5, 1} }, { false, {11, 1} } }));
+        assert(events.uncrosses.size() == 1 && events.uncrosses[0] == std::make_tuple(true, PriceQuantity{ 11.5, 1 }, size_t{ 2 }));
+        assert(events.tops.back() == Top({ {11.5, 1} }, { {12, 4} }));
+
+        // Diffs report deletions, and a snapshot reports the levels it no longer has
+        events.removed.clear();
+        book.apply_delta({ {10.2, 0} }, {});
+        assert((events.removed == std::vector<Removed>{ { true, {10.2, 2} } }));
+        events.removed.clear();
+        const size_t tops = events.tops.size();
+        book.replace({ {11.5, 1}, {7, 1} }, { {12, 4} });
+        assert((events.removed == std::vector<Removed>{ { true, {10, 1} } }) && events.tops.size() == tops);
+        book.replace({}, {});
+        assert(events.tops.back() == Top(std::nullopt, std::nullopt));
+
+        // Fixed-point books report ticks; callbacks a listener doesn't declare do nothing
+        BinanceBook<20, SoaSide, FixedPointPricing, TopListener> ticks(FixedPointPricing{ 2, 2 }, TopListener{});
+        ticks.update_bbo(BasicBookTicker<FixedPointPricing::Level>{ 1, { 100, 1 }, { 101, 1 } });
+        ticks.update_bbo(BasicBookTicker<FixedPointPricing::Level>{ 2, { 101, 1 }, { 102, 1 } });
+        ticks.update_bbo(BasicBookTicker<FixedPointPricing::Level>{ 3, { 101, 1 }, { 102, 1 } });
+        assert(ticks.listener_policy().changes == 2);
+
+        std::cout << "Test listener passed.\n";
+    }
+
+    static void test_book_traits()
+    {
+        static_assert(BidSide::better(2, 1) && !BidSide::better(1, 1) && AskSide::better(1, 2) && !AskSide::better(2, 1));
+        static_assert(std::is_same_v<BinanceBook<20>, BasicBinanceBook<BookTraits<20>>>);
+        static_assert(std::is_same_v<BinanceBook<20>::UncrossPolicy, DropCrossed>);
+
+        // A diff level crossing the other side leaves it alone until the feed deletes the crossed level
+        using Removed = std::pair<bool, PriceQuantity>;
+        BinanceBook<5, RingSide, FloatingPointPricing, RecordingListener, KeepCrossed> keeping;
+        keeping.replace({ {10, 1}, {9, 1} }, { {11, 1}, {12, 1} });
+        keeping.apply_delta({ {11, 2} }, {});
+        assert(keeping.best_bid()->price == 11 && keeping.best_ask()->price == 11);
+        assert(keeping.listener_policy().uncrosses.empty() && keeping.listener_policy().removed.empty());
+        keeping.apply_delta({}, { {11, 0} });
+        assert((keeping.extract() == std::make_pair(std::vector<PriceQuantity>{ {11, 2}, {10, 1}, {9, 1} },
+                                                    std::vector<PriceQuantity>{ {12, 1} })));
+
+        // In a ticker the ask's own new top drops what the bid crossed, so both policies end up in the same place,
+        // only the uncross isn't reported as one
+        BinanceBook<5> dropping;
+        dropping.replace({ {10, 1}, {9, 1} }, { {11, 1}, {12, 1} });
+        keeping.replace({ {10, 1}, {9, 1} }, { {11, 1}, {12, 1} });
+        keeping.listener_policy().removed.clear();
+        dropping.update_bbo({ 11.5, 1 }, { 12, 3 });
+        keeping.update_bbo({ 11.5, 1 }, { 12, 3 });
+        assert(dropping.extract() == keeping.extract());
+        assert(keeping.listener_policy().uncrosses.empty());
+        assert((keeping.listener_policy().removed == std::vector<Removed>{ { false, {11, 1} } }));
+
+        // Any type with the BookTraits members will do
+        BasicBinanceBook<TickTraits> ticks(FixedPointPricing{ 2, 2 });
+        static_assert(decltype(ticks)::max_depth == 10);
+        ticks.replace({ {1.00, 1}, {0.99, 1} }, { {1.01, 1}, {1.02, 1} });
+        ticks.apply_delta({ {1.01, 3} }, {});
+        assert(ticks.best_bid()->price == 1.01 && ticks.best_ask()->price == 1.01);
+        ticks.apply_delta({}, { {1.01, 0} });
+        assert(ticks.best_ask()->price == 1.02 && ticks.depth() == std::make_pair(size_t{ 3 }, size_t{ 1 }));
+
+        std::cout << "Test book traits passed.\n";
+    }
+
+    static void test_book_checkpoint()
+    {
+        const std::string path = (std::filesystem::temp_directory_path() / "binancebook_checkpoint_test.bin").string();
+        using Book = BinanceBook<20>;
+        BookRegistry<Book> books(8);
+        for (const char* symbol : { "BTCUSDT", "ETHUSDT", "SOLUSDT" })
+            books.add(symbol);
+        assert(books.symbol(1) == "ETHUSDT");
+        books.at(0).replace(100, { {20000, 1}, {19999, 2} }, { {20001, 3} });
+        books.at(1).replace(200, { {1800, 5} }, { {1801, 6}, {1802, 7} });
+        books.at(1).update_bbo(201, { 1800.5, 1 }, { 1801, 6 });
+
+        {
+            CheckpointWriter writer(path, 8, 20);
+            assert(writer.ok() && writer.generation() == 0);
+
+            // A pass in steps of two books, nothing readable until it completes
+            const size_t first_step = writer.step(books, 2);
+            assert(first_step == 2 && writer.generation() == 0);
+            assert(!CheckpointReader(path).ok());
+            const size_t second_step = writer.step(books, 2);
+            assert(second_step == 1 && writer.generation() == 1);
+
+            // The next pass goes into the other copy, the first stays readable until it's done
+            books.at(0).update_bbo(101, { 20000.5, 1 }, { 20001, 3 });
+            const size_t next_pass_step = writer.step(books, 1);
+            assert(next_pass_step == 1);
+            CheckpointReader partial(path);
+            assert(partial.ok() && partial.generation() == 1 && partial.at(0).update_id == 100);
+        }
+
+        CheckpointReader reader(path);
+        assert(reader.ok() && reader.size() == 3 && reader.depth() == 20 && reader.saved_ns() > 0);
+        const CheckpointEntry eth = reader.at(1);
+        assert(eth.symbol == "ETHUSDT" && eth.update_id == 201 && eth.snapshot_id == 200);
+        assert(eth.bids.size() == 2 && eth.bids[0] == PriceQuantity(1800.5, 1) && eth.asks.size() == 2);
+
+        // A restarted process: books are served straight away with the saved update ids, and reconcile from there
+        BookRegistry<SeqlockBook<Book>> restarted(8);
+        restarted.add("ETHUSDT");
+        restarted.add("BTCUSDT");
+        restarted.add("XRPUSDT");
+        const size_t restored = reader.restore(restarted);
+        assert(restored == 2);
+        assert((restarted.find("ETHUSDT")->unsafe_book().extract() == books.at(1).extract()));
+        assert(restarted.find("BTCUSDT")->unsafe_book().last_update_id() == 100);
+        assert(restarted.find("XRPUSDT")->unsafe_book().is_empty());
+        const bool older = restarted.find("ETHUSDT")->update_bbo(150, PriceQuantity{ 1799, 1 }, PriceQuantity{ 1803, 1 }); // Older than the checkpoint
+        const bool newer = restarted.find("ETHUSDT")->update_bbo(202, PriceQuantity{ 1800.6, 1 }, PriceQuantity{ 1801, 6 });
+        assert(!older && newer);
+
+        // Diffs carry on from the checkpoint's id too
+        SeqlockBook<Book>& eth_book = *restarted.find("ETHUSDT");
+        const std::vector<PriceQuantity> no_levels;
+        const DeltaResult before_checkpoint = eth_book.apply_delta(190, 195, std::vector<PriceQuantity>{ {1700, 1} }, no_levels);
+        const DeltaResult continues = eth_book.apply_delta(198, 203, std::vector<PriceQuantity>{ {1799, 4} }, no_levels);
+        assert(before_checkpoint == DeltaResult::Stale && continues == DeltaResult::Applied);
+        assert(eth_book.unsafe_book().snapshot_update_id() == 201 && eth_book.unsafe_book().diff_update_id() == 203);
+
+        // A writer opened again on the file (a restart) keeps the last complete pass until its own first one is done
+        {
+            CheckpointWriter reopened(path, 8, 20);
+            assert(reopened.ok() && reopened.generation() == 1);
+            CheckpointReader kept(path);
+            assert(kept.ok() && kept.size() == 3 && kept.at(1).update_id == 201);
+        }
+
+        // Seqlocked books are read through the seqlock, so this could run on a thread of its own
+        CheckpointWriter seqlocked(path, 8, 20);
+        seqlocked.save(restarted);
+        const CheckpointReader resaved(path);
+        assert(seqlocked.generation() == 2 && resaved.at(0).update_id == 203);
+
+        // Another layout starts over
+        {
+            CheckpointWriter deeper(path, 8, 50);
+            assert(deeper.ok() && deeper.generation() == 0 && !CheckpointReader(path).ok());
+        }
+
+        // Not a checkpoint
+        assert(!CheckpointReader((std::filesystem::temp_directory_path() / "binancebook_no_such_file").string()).ok());
+
+        // A damaged header whose layout would wrap the file size round to just the header: refused, not read past
+        {
+            CheckpointFileHeader forged{};
+            std::memcpy(forged.magic, CheckpointFileHeader::expected_magic, sizeof(forged.magic));
+            forged.version = CheckpointFileHeader::current_version;
+            forged.depth = 20;
+            forged.capacity = uint64_t{ 1 } << 60; // 2 * 2^60 * 696 bytes is 0 mod 2^64
+            forged.generation = 1;
+            forged.counts[0] = 1;
+            assert(checkpoint_file_size(forged.capacity, forged.depth) == sizeof(forged));
+            std::FILE* out = std::fopen(path.c_str(), "wb");
+            const bool written = out != nullptr && std::fwrite(&forged, sizeof(forged), 1, out) == 1;
+            if (out != nullptr)
+                std::fclose(out);
+            assert(written && !CheckpointReader(path).ok());
+        }
+        std::filesystem::remove(path);
+
+        std::cout << "Test book checkpoint passed.\n";
+    }
+
+    static void test_consolidated_book()
+    {
+        using Merged = ConsolidatedBook<3, 5>;
+        using Book = BinanceBook<5, RingSide, FloatingPointPricing, Merged::Feed<>>;
+        Merged merged;
+        std::array<Book, 3> venues;
+        assert(merged.best_bid() == nullptr && !merged.crossed());
+
+        // A book that already has levels brings them along when it's attached
+        venues[0].replace({ {10, 1}, {9, 1} }, { {11, 1}, {12, 1} });
+        for (size_t v = 0; v < venues.size(); ++v)
+            merged.attach(v, venues[v]);
+        venues[1].replace({ {10, 2}, {9.5, 1} }, { {11.5, 1} });
+        assert(merged.best_bid()->price == 10 && merged.best_bid()->quantity == 3);
+        assert((merged.best_bid()->venue_quantity == std::array<Quantity, 3>{ 1, 2, 0 }));
+        assert(merged.depth() == std::make_pair(size_t{ 3 }, size_t{ 3 }) && merged.bid(1).price == 9.5 && merged.ask(2).price == 12);
+
+        // Only the levels that changed are merged: the other venues aren't looked at
+        const uint64_t before = merged.level_updates();
+        venues[0].update_bbo({ 10, 4 }, { 11, 1 }); // Bid quantity only
+        assert(merged.level_updates() == before + 1 && merged.best_bid()->quantity == 6);
+        venues[1].apply_delta({ {9.5, 0} }, { {11.5, 3} });
+        assert(merged.level_updates() == before + 3 && merged.bid(1).price == 9);
+
+        // A venue's bid through another's ask is kept, and reported
+        venues[2].update_bbo({ 11.2, 4 }, { 11.3, 4 });
+        assert(merged.crossed() && merged.best_bid()->price == 11.2 && merged.best_ask()->price == 11);
+        merged.detach(2, venues[2]);
+        assert(!merged.crossed() && merged.best_bid()->price == 10 && merged.depth().first == 2);
+        venues[2].update_bbo({ 11.2, 5 }, { 11.3, 4 });
+        assert(merged.best_bid()->price == 10);
+        merged.attach(2, venues[2]);
+        assert(merged.best_bid()->price == 11.2 && merged.best_bid()->quantity == 5);
+
+        // Random walk on every venue, checked against merging the extracts from scratch
+        std::mt19937 rng(25);
+        std::uniform_int_distribution<int> venue_of(0, 2), offset(1, 8), quantity(0, 3), kind(0, 9);
+        double mid = 100;
+        for (int step = 0; step < 5000; ++step) {
+            const int v = venue_of(rng);
+            mid += (kind(rng) - 4.5) / 2;
+            if (kind(rng) == 0) {
+                std::vector<PriceQuantity> bids, asks;
+                for (int i = 1; i <= 5; ++i) {
+                    bids.push_back({ mid - i, 1.0 + quantity(rng) });
+                    asks.push_back({ mid + i, 1.0 + quantity(rng) });
+                }
+                venues[v].replace(bids, asks);
+            }
+            else if (kind(rng) < 5) {
+                venues[v].update_bbo({ mid - offset(rng), 1.0 + quantity(rng) }, { mid + offset(rng), 1.0 + quantity(rng) });
+            }
+            else {
+                venues[v].apply_delta({ { mid - offset(rng), 1.0 * quantity(rng) } }, { { mid + offset(rng), 1.0 * quantity(rng) } });
+            }
+            if (step % 1000 == 999)
+                venues[v].clear();
+
+            std::map<Price, std::array<Quantity, 3>, std::greater<>> bids;
+            std::map<Price, std::array<Quantity, 3>> asks;
+            for (size_t i = 0; i < 3; ++i) {
+                const auto [venue_bids, venue_asks] = venues[i].extract();
+                for (const PriceQuantity& level : venue_bids)
+                    bids[level.price][i] = level.quantity;
+                for (const PriceQuantity& level : venue_asks)
+                    asks[level.price][i] = level.quantity;
+            }
+            assert(merged.depth() == std::make_pair(bids.size(), asks.size()));
+            size_t i = 0;
+            for (const auto& [price, by_venue] : bids) {
+                assert(merged.bid(i).price == price && merged.bid(i).venue_quantity == by_venue);
+                assert(merged.bid(i++).quantity == by_venue[0] + by_venue[1] + by_venue[2]);
+            }
+            i = 0;
+            for (const auto& [price, by_venue] : asks)
+                assert(merged.ask(i).price == price && merged.ask(i++).venue_quantity == by_venue);
+        }
+
+        std::cout << "Test consolidated book passed.\n";
+    }
+
+    static void test_book_history()
+    {
+        using Book = BinanceBook<10>;
+        Book book;
+        BookHistory<Book> history(HistoryOptions{ /*keyframes=*/4, /*keyframe_interval=*/8, /*changes_per_keyframe=*/24 });
+        HistoryState<10> state;
+        const bool found_empty = history.state_at(1, state);
+        assert(!found_empty && !history.oldest_update_id());
+
+        // Random walk of snapshots, tickers and diffs, remembering every state to compare with
+        std::mt19937 rng(23);
+        std::uniform_int_distribution<int> offset(1, 12), quantity(0, 4), kind(0, 9);
+        std::map<uint64_t, std::pair<std::vector<PriceQuantity>, std::vector<PriceQuantity>>> truth;
+        double mid = 1000;
+        for (uint64_t id = 1; id <= 400; ++id) {
+            mid += kind(rng) - 4.5;
+            if (kind(rng) == 0) {
+                std::vector<PriceQuantity> bids, asks;
+                for (int i = 1; i <= 10; ++i) {
+                    bids.push_back({ mid - i, 1.0 + quantity(rng) });
+                    asks.push_back({ mid + i, 1.0 + quantity(rng) });
+                }
+                book.replace(bids, asks);
+            }
+            else if (kind(rng) < 4) {
+                book.update_bbo({ mid - offset(rng), 1.0 + quantity(rng) }, { mid + offset(rng), 1.0 + quantity(rng) });
+            }
+            else {
+                book.apply_delta({ { mid - offset(rng), 1.0 * quantity(rng) } }, { { mid + offset(rng), 1.0 * quantity(rng) } });
+            }
+            const bool recorded = history.record(book, id, static_cast<int64_t>(id) * 1000);
+            assert(recorded);
+            truth[id] = book.extract();
+        }
+        const bool same_id = history.record(book, 400, 400'000);
+        const bool earlier_time = history.record(book, 401, 399'999);
+        assert(!same_id && !earlier_time && history.records() == 400);
+
+        // Everything still held rebuilds exactly; anything older is gone. Some segments ran out of room for changes
+        // before 8 states, so it's fewer than 4 full segments.
+        const uint64_t oldest = *history.oldest_update_id();
+        assert(oldest > 400 - 4 * 8 && history.size() == 400 - oldest + 1);
+        for (uint64_t id = oldest; id <= 400; ++id) {
+            const bool found = history.state_at(id, state);
+            assert(found && state.update_id == id);
+            assert(std::ranges::equal(state.bids(), truth[id].first) && std::ranges::equal(state.asks(), truth[id].second));
+        }
+        const bool found_older = history.state_at(oldest - 1, state);
+        assert(!found_older);
+
+        // By time: the last update at or before it, and ids past the last one give the latest
+        const bool found_by_time = history.state_at_time(static_cast<int64_t>(oldest) * 1000 + 999, state);
+        assert(found_by_time && state.update_id == oldest);
+        const bool found_latest = history.state_at(1'000'000, state);
+        assert(found_latest && state.update_id == 400);
+        const bool found_before_time = history.state_at_time(static_cast<int64_t>(oldest) * 1000 - 1, state);
+        assert(!found_before_time);
+
+        // With the default options a 20 level book's history takes under a quarter of what full copies of the
+        // states it's sure to hold would
+        const BookHistory<BinanceBook<20>> deep;
+        const HistoryOptions defaults;
+        assert(deep.memory_bytes() * 4 < (defaults.keyframes - 1) * defaults.keyframe_interval * 2 * 20 * sizeof(PriceQuantity));
+
+        history.clear();
+        const bool found_cleared = history.state_at(400, state);
+        assert(history.size() == 0 && !found_cleared);
+
+        std::cout << "Test book history passed.\n";
+    }
+
+    static void test_depth_analytics()
+    {
+        BinanceBook<5, AnalyticRingSide> book;
+        book.replace({ {10, 1}, {9, 2}, {8, 3} }, { {11, 2}, {12, 2}, {13, 4} });
+
+        assert(*book.microprice() == (10.0 * 2 + 11.0 * 1) / 3);
+        assert(*book.imbalance() == -1.0 / 3 && *book.imbalance(3) == -2.0 / 14);
+        assert(book.bid_depth(2).quantity == 3 && book.bid_depth(2).notional == 28 && book.bid_depth(100).quantity == 6);
+        assert(book.ask_depth(0).quantity == 0);
+
+        // 5 to buy: 2 @ 11, 2 @ 12, 1 @ 13
+        const auto buy = book.cost_to_buy(5);
+        assert(buy.quantity == 5 && buy.notional == 22 + 24 + 13 && buy.average_price == 59.0 / 5);
+        assert(buy.worst_price == 13 && buy.levels == 3);
+        // More than there is: the whole side
+        const auto sell = book.cost_to_sell(10);
+        assert(sell.quantity == 6 && sell.notional == 10 + 18 + 24 && sell.levels == 3 && sell.worst_price == 8);
+        assert(book.cost_to_buy(2).levels == 1 && book.cost_to_buy(2.5).levels == 2);
+
+        // Kept up through a new top that pushes levels out and uncrosses the other side
+        book.update_bbo({ 11.5, 1 }, { 12, 5 });
+        assert(book.bid_depth(5).quantity == 7 && book.ask_depth(5).quantity == 9 && book.ask_depth(1).notional == 60);
+
+        BinanceBook<20> empty;
+        assert(!empty.microprice() && !empty.imbalance() && empty.cost_to_buy(1).levels == 0);
+
+        // A ladder drops and sets levels behind the sums' back, so wrapping one doesn't compile
+        static_assert(wraps_in_analytics<RingSide> && wraps_in_analytics<SoaSide>);
+        static_assert(!wraps_in_analytics<LadderSide>);
+
+        std::cout << "Test depth analytics passed.\n";
+    }
+
+    template <template <typename, size_t> class Inner>
+    static constexpr bool wraps_in_analytics = requires { typename AnalyticSide<Inner, FixedPointPricing::Level, 20>; };
+
+    // The maintained sums against the same book with plain storage, through every kind of update
+    template <size_t n, template <typename, size_t> class Storage>
+    static void test_depth_analytics_random()
+    {
+        BinanceBook<n, Storage> analytic;
+        BinanceBook<n, SoaSide> plain;
+
+        std::mt19937 rng(17);
+        std::uniform_int_distribution<int> tick(-30, 30);
+        std::uniform_int_distribution<int> lots(0, 40);
+        std::uniform_int_distribution<int> action(0, 9);
+
+        const auto close = [](double a, double b) { return std::abs(a - b) <= 1e-9 * std::max(1.0, std::abs(b)); };
+        for (int i = 0; i < 20000; ++i) {
+            const int what = action(rng);
+            if (what == 0) {
+                std::vector<PriceQuantity> bids, asks;
+                for (int l = 0; l < lots(rng); ++l) {
+                    bids.push_back({ 1000.0 - l * 0.5, 1 + lots(rng) * 0.125 });
+                    asks.push_back({ 1001.0 + l * 0.5, 1 + lots(rng) * 0.125 });
+                }
+                analytic.replace(bids, asks);
+                plain.replace(bids, asks);
+            }
+            else if (what < 5) {
+                const PriceQuantity bid{ 1000.0 + tick(rng) * 0.5, 1 + lots(rng) * 0.125 };
+                const PriceQuantity ask{ bid.price + 0.5 + (lots(rng) % 3) * 0.5, 1 + lots(rng) * 0.125 };
+                analytic.update_bbo(bid, ask);
+                plain.update_bbo(bid, ask);
+            }
+            else {
+                std::vector<PriceQuantity> bids, asks;
+                for (int l = lots(rng) % 4; l >= 0; --l) {
+                    bids.push_back({ 1000.0 + tick(rng) * 0.5, lots(rng) % 5 * 0.25 });
+                    asks.push_back({ 1000.0 + tick(rng) * 0.5, lots(rng) % 5 * 0.25 });
+                }
+                analytic.apply_delta(bids, asks);
+                plain.apply_delta(bids, asks);
+            }
+
+            assert(analytic.extract() == plain.extract());
+            for (size_t k = 0; k <= n; k += 3) {
+                assert(close(analytic.bid_depth(k).quantity, plain.bid_depth(k).quantity));
+                assert(close(analytic.ask_depth(k).notional, plain.ask_depth(k).notional));
+            }
+            const double quantity = lots(rng) * 0.75;
+            const auto a = analytic.cost_to_buy(quantity), p = plain.cost_to_buy(quantity);
+            assert(a.levels == p.levels && close(a.quantity, p.quantity) && close(a.notional, p.notional));
+            const auto as = analytic.cost_to_sell(quantity), ps = plain.cost_to_sell(quantity);
+            assert(as.levels == ps.levels && close(as.notional, ps.notional));
+        }
+        std::cout << "Test depth analytics random<" << n << "> passed.\n";
+    }
+
+    /*
+    The tick ladder against a RingSide book with the same fixed-point levels. Random snapshots, tickers and diffs
+    around a mid that drifts by drift ticks a step: while the levels fit in the window the books are identical, once
+    the mid has moved far enough the ladder drops levels that fell out of the window, so its sides are a prefix.
+    */
+    // A full side only gives up its worst level for a new one it can hold, and says what it dropped
+    static void test_ladder_window()
+    {
+        using Tick = FixedPointPricing::Level;
+        BasicLadderSide<Tick, 4, 1024> side;
+        side.orient(/*bid_side=*/true);
+        for (int64_t price = 1000; price > 996; --price)
+            side.push_back({ price, 1 });
+
+        std::vector<Tick> dropped;
+        const auto record = [&](const Tick& level) { dropped.push_back(level); };
+        const bool held_far = side.insert(0, { 100, 1 }, record); // Past the window
+        assert(!held_far && dropped.empty() && side.size() == 4 && side.back().price == 997);
+        const bool held_inside = side.insert(0, { 998, 2 }, record); // Already there
+        assert(held_inside && dropped.empty() && side.find(998)->quantity == 2);
+
+        // A new best most of a window away: the window moves and takes the back of the side with it
+        const bool held_top = side.push_front({ 1000 + 900, 1 }, record);
+        assert(held_top && side.size() == 1 && side.front().price == 1900);
+        assert((dropped == std::vector<Tick>{ {997, 1}, {998, 2}, {999, 1}, {1000, 1} }));
+
+        std::cout << "Test ladder window passed.\n";
+    }
+
+    template <size_t n>
+    static void test_ladder_matches_ring(int spread, int drift, int steps, int jump = 0)
+    {
+        using Tick = FixedPointPricing::Level;
+        const FixedPointPricing pricing{ 2, 3 };
+        auto ladder = std::make_unique<BinanceBook<n, LadderSide, FixedPointPricing>>(pricing);
+        auto ring = std::make_unique<BinanceBook<n, RingSide, FixedPointPricing>>(pricing);
+
+        std::mt19937 rng(static_cast<unsigned>(n + drift));
+        std::uniform_int_distribution<int> offset(0, spread);
+        std::uniform_int_distribution<int> lots(0, 50);
+        std::uniform_int_distribution<int> action(0, 19);
+        std::uniform_int_distribution<int> step(-drift, drift);
+        std::uniform_int_distribution<int> jumps(0, 49);
+
+        int64_t mid = 1'000'000;
+        uint64_t id = 0;
+        for (int i = 0; i < steps; ++i) {
+            mid += step(rng);
+            // The market moving most of a window at once: whatever falls off the ladder's window is gone for it
+            if (jump != 0 && jumps(rng) == 0)
+                mid += lots(rng) % 2 == 0 ? jump : -jump;
+            const int what = action(rng);
+            if (what == 0) {
+                std::vector<Tick> bids, asks;
+                for (int64_t l = 0; l < static_cast<int64_t>(n) + 10; ++l) {
+                    if (lots(rng) < 10)
+                        continue;
+                    bids.push_back({ mid - 1 - l, lots(rng) + 1 });
+                    asks.push_back({ mid + 1 + l, lots(rng) + 1 });
+                }
+                ladder->replace(++id, bids, asks);
+                ring->replace(id, bids, asks);
+            }
+            else if (what < 6) {
+                const BasicBookTicker<Tick> ticker{ ++id, { mid - offset(rng) % 4, lots(rng) + 1 }, { mid + 1 + offset(rng) % 4, lots(rng) + 1 } };
+                ladder->update_bbo(ticker);
+                ring->update_bbo(ticker);
+            }
+            else {
+                std::vector<Tick> bids, asks;
+                for (int l = lots(rng) % 8; l >= 0; --l) {
+                    bids.push_back({ mid - offset(rng), lots(rng) % 4 == 0 ? 0 : lots(rng) });
+                    asks.push_back({ mid + offset(rng), lots(rng) % 4 == 0 ? 0 : lots(rng) });
+                }
+                ladder->apply_delta(bids, asks);
+                ring->apply_delta(bids, asks);
+            }
+
+            const auto [ladder_bids, ladder_asks] = ladder->extract();
+            const auto [ring_bids, ring_asks] = ring->extract();
+            if (drift == 0 && jump == 0) {
+                assert(ladder_bids == ring_bids && ladder_asks == ring_asks);
+            }
+            else {
+                assert(ladder_bids.size() <= ring_bids.size() && std::equal(ladder_bids.begin(), ladder_bids.end(), ring_bids.begin()));
+                assert(ladder_asks.size() <= ring_asks.size() && std::equal(ladder_asks.begin(), ladder_asks.end(), ring_asks.begin()));
+            }
+            // After a jump the ladder can have lost every level the deletes left, the prefix above is all it owes
+            if (jump == 0)
+                assert(ladder->best_bid() == ring->best_bid() && ladder->best_ask() == ring->best_ask());
+        }
+        std::cout << "Test ladder matches ring<" << n << "> (drift " << drift << ", jump " << jump << ") passed.\n";
+    }
+
+    static void test_format_to()
+    {
+        BinanceBook<20, SoaSide> book;
+        book.replace({ {20078.54, 0.00431}, {20078.39, 0.001}, {20078.27, 0.0007} }, { {20078.91, 0.03497}, {20078.95, 0.001} });
+
+        assert(book.to_string() ==
+            "[ 1] [   0.00431] 20078.54000000 | 20078.91000000 [0.03497   ]\n"
+            "[ 2] [     0.001] 20078.39000000 | 20078.95000000 [0.001     ]\n"
+            "[ 3] [    0.0007] 20078.27000000 |\n");
+
+        const BinanceBook<20, SoaSide>::FormatOptions options{ .price_precision = 3, .quantity_precision = 5, .top_k = 2 };
+        const std::string expected =
+            "[ 1] [0.00431] 20078.540 | 20078.910 [0.03497]\n"
+            "[ 2] [  0.001] 20078.390 | 20078.950 [0.001  ]\n";
+        assert(book.to_string(options) == expected);
+
+        // Into a caller buffer, which has to be big enough for all of it
+        char buffer[256];
+        const auto written = book.format_to(buffer, sizeof(buffer), options);
+        assert(written && std::string_view(buffer, *written) == expected);
+        const auto one_short = book.format_to(buffer, expected.size() - 1, options);
+        const auto exact_fit = book.format_to(buffer, expected.size(), options);
+        assert(!one_short && exact_fit == expected.size());
+
+        // Rows past the end of the bids keep the asks in their column
+        book.replace({ {5, 1} }, { {6, 1}, {7, 0.5} });
+        assert(book.to_string({ 2, 1, 20 }) ==
+            "[ 1] [  1] 5.00 | 6.00 [1  ]\n"
+            "                | 7.00 [0.5]\n");
+
+        BinanceBook<20> empty;
+        const auto nothing = empty.format_to(buffer, 0);
+        assert(empty.to_string().empty() && nothing == size_t{ 0 });
+
+        // The integer fast path prints the same digits as fixed-precision to_chars for decimal prices and quantities
+        std::mt19937 rng(3);
+        std::uniform_int_distribution<long long> units(0, 99'999'999'999);
+        for (int i = 0; i < 20000; ++i) {
+            const int decimals = i % 9;
+            const double value = static_cast<double>(units(rng)) / pow10_double[decimals];
+            for (int precision = decimals; precision <= 10; precision += 2) {
+                char fast[64], reference[64];
+                char* fast_end = format_double_to(fast, fast + sizeof(fast), value, precision);
+                char* reference_end = std::to_chars(reference, reference + sizeof(reference), value, std::chars_format::fixed, precision).ptr;
+                assert(std::string_view(fast, fast_end) == std::string_view(reference, reference_end));
+            }
+        }
+        const auto format = [](double value, int precision, bool trim) {
+            char out[32];
+            char* end = format_double_to(out, out + sizeof(out), value, precision, trim);
+            return end ? std::string(out, end) : std::string("(null)");
+        };
+        assert(format(0.0007, 8, true) == "0.0007" && format(20078.5, 3, false) == "20078.500" && format(2, 0, true) == "2");
+        assert(format(-1.25, 3, false) == "-1.250" && format(0, 2, true) == "0" && format(1e300, 8, false) == "1e+300");
+        // Only the fraction is trimmed, never the exponent or an integer
+        assert(format(1e30, 8, true) == "1e+30" && format(1.5e30, 8, true) == "1.5e+30" && format(120000, 0, true) == "120000");
+        char point_zero[] = "2.50e+10";
+        assert(std::string_view(point_zero, trim_fraction_zeros(point_zero, point_zero + 8)) == "2.5e+10");
+        char tiny[4];
+        const char* overflow = format_double_to(tiny, tiny + sizeof(tiny), 12.5, 2);
+        assert(overflow == nullptr);
+
+        std::cout << "Test format_to passed.\n";
+    }
+
 };
 
 static void runTests()
@@ -566,5 +2187,68 @@ static void runTests()
 
     Tests::test_book_overflow_handling();
 
+    Tests::test_depth_follows_template_n();
+    Tests::test_ring_wraparound();
+
+    Tests::test_soa_matches_ring<5>();
+    Tests::test_soa_matches_ring<20>();
+    Tests::test_soa_matches_ring<100>();
+
+    Tests::test_fixed_point_matches_floating_point<RingSide>();
+    Tests::test_fixed_point_matches_floating_point<SoaSide>();
+    Tests::test_fixed_point_exact_levels();
+
+    Tests::test_views();
+    Tests::test_replace_generic_ranges();
+
+    Tests::test_parse_depth_and_ticker();
+    Tests::test_book_registry();
+    Tests::test_book_arena();
+
+    Tests::test_sharded_engine(/*busy_poll=*/false);
+    Tests::test_sharded_engine(/*busy_poll=*/true);
+
+    Tests::test_seqlock_snapshots<RingSide>();
+    Tests::test_seqlock_snapshots<SoaSide>();
+
+    Tests::test_update_id_sequencing();
+    Tests::test_bbo_batches<RingSide>();
+    Tests::test_bbo_batches<SoaSide>();
+
+    Tests::test_capture_replay();
+
+    Tests::test_book_counters();
+
+    Tests::test_format_to();
+
+    Tests::test_apply_delta();
+    Tests::test_apply_delta_random<10, RingSide>();
+    Tests::test_apply_delta_random<10, SoaSide>();
+    Tests::test_apply_delta_random<100, RingSide>();
+    Tests::test_apply_delta_random<100, SoaSide>();
+
+    Tests::test_replace_change_set();
+
+    Tests::test_listener();
+
+    Tests::test_book_traits();
+
+    Tests::test_book_history();
+    Tests::test_consolidated_book();
+    Tests::test_book_checkpoint();
+
+    Tests::test_depth_analytics();
+    Tests::test_depth_analytics_random<8, AnalyticRingSide>();
+    Tests::test_depth_analytics_random<8, AnalyticSoaSide>();
+    Tests::test_depth_analytics_random<20, AnalyticRingSide>();
+    Tests::test_depth_analytics_random<20, AnalyticSoaSide>();
+
+    Tests::test_ladder_window();
+    Tests::test_ladder_matches_ring<20>(/*spread=*/40, /*drift=*/0, 20000);
+    Tests::test_ladder_matches_ring<20>(/*spread=*/40, /*drift=*/30, 20000);
+    Tests::test_ladder_matches_ring<20>(/*spread=*/40, /*drift=*/5, 20000, /*jump=*/500);
+    Tests::test_ladder_matches_ring<20>(/*spread=*/300, /*drift=*/0, 20000, /*jump=*/900);
+    Tests::test_ladder_matches_ring<5000>(/*spread=*/6000, /*drift=*/0, 1000);
+
     std::cout << "All Tests Passed Successfully";
 }
\ No newline at end of file
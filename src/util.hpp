@@ -26,6 +26,14 @@ public:
     ~Timer() { std::cout << elapsed() << "\n"; }
 };
 
+// Same clock as Timer, for code that records timings instead of printing them
+inline int64_t steady_now_ns()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+#include <array>
+#include <cstdint>
 #include <limits>
 #include <tgmath.h>
 
@@ -46,4 +54,91 @@ inline std::string format_double(double value, int precision = 8) {
         return std::string(buffer, ptr);
     }
     return {}; // In case of an error, return an empty string
+}
+// Powers of ten, all exactly representable: up to 1e22 as doubles and 1e18 as int64_t
+inline constexpr auto pow10_double = [] {
+    std::array<double, 23> table{};
+    double value = 1;
+    for (auto& entry : table) {
+        entry = value;
+        value *= 10;
+    }
+    return table;
+}();
+
+inline constexpr auto pow10_int = [] {
+    std::array<int64_t, 19> table{};
+    table[0] = 1;
+    for (size_t i = 1; i < table.size(); ++i)
+        table[i] = table[i - 1] * 10;
+    return table;
+}();
+
+#include <algorithm>
+
+// Drop the trailing zeros (and then a bare '.') of the fraction in [first, end), keeping any exponent after it.
+// Without a '.' there's no fraction and nothing is dropped. Returns the new end.
+inline char* trim_fraction_zeros(char* first, char* end)
+{
+    char* const exponent = std::find(first, end, 'e');
+    if (std::find(first, exponent, '.') == exponent)
+        return end;
+    char* fraction_end = exponent;
+    while (fraction_end[-1] == '0')
+        --fraction_end;
+    if (fraction_end[-1] == '.')
+        --fraction_end;
+    return std::copy(exponent, end, fraction_end);
+}
+
+// Like format_double, but into [first, last) without allocating. Optionally drops trailing zeros (and a bare '.')
+// after the point. Values too large for fixed notation in the space given fall back to the shortest general form.
+// Returns the end of what was written, or nullptr if even that doesn't fit.
+inline char* format_double_to(char* first, char* last, double value, int precision, bool trim_zeros = false)
+{
+    char* end;
+    if (precision >= 0 && precision <= 15 && std::fabs(value) < 1e15 / pow10_double[precision]) {
+        /*
+        Fast path for everything a book holds. Scaled by 10^precision the value is an integer below 2^53, so it can be
+        printed with integer to_chars and a decimal point put in, which is several times quicker than fixed-precision
+        to_chars. The result is the same except when the value is within an ulp of a rounding tie in the last digit.
+        */
+        const long long units = std::llround(value * pow10_double[precision]);
+        char digits[24];
+        char* digits_end = std::to_chars(digits, digits + sizeof(digits), units < 0 ? -units : units).ptr;
+        const auto length = static_cast<int>(digits_end - digits);
+        const int integer_length = length > precision ? length - precision : 1;
+        const int needed = (units < 0) + integer_length + (precision > 0) + precision;
+        if (last - first < needed)
+            return nullptr;
+
+        end = first;
+        if (units < 0)
+            *end++ = '-';
+        if (length > precision) {
+            end = std::copy(digits, digits + integer_length, end);
+        }
+        else {
+            *end++ = '0';
+        }
+        if (precision > 0) {
+            *end++ = '.';
+            // Leading zeros of the fraction for values below 1: 0.00431 is 431 at precision 5
+            for (int i = length; i < precision; ++i)
+                *end++ = '0';
+            end = std::copy(digits_end - std::min(length, precision), digits_end, end);
+        }
+    }
+    else {
+        auto [fixed_end, ec] = std::to_chars(first, last, value, std::chars_format::fixed, precision);
+        if (ec != std::errc()) {
+            auto [general_end, general_ec] = std::to_chars(first, last, value);
+            if (general_ec != std::errc())
+                return nullptr;
+            fixed_end = general_end;
+        }
+        end = fixed_end;
+    }
+
+    return trim_zeros ? trim_fraction_zeros(first, end) : end;
 }
\ No newline at end of file